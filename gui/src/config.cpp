@@ -111,8 +111,35 @@ AudioConfig load_audio_config(const toml::node_view<toml::node>& v) {
     int bitrate = v["bitrate"].value_or(192);
     bitrate = std::clamp(bitrate, 128, 256);
 
+    int sample_rate = v["sample_rate"].value_or(48000);
+    if (std::ranges::find(SAMPLE_RATES, sample_rate) == SAMPLE_RATES.end()) {
+        sample_rate = 48000;
+    }
+
+    int analysis_rate = v["analysis_rate"].value_or(0);
+    if (std::ranges::find(ANALYSIS_RATES, analysis_rate) == ANALYSIS_RATES.end()) {
+        analysis_rate = 0;
+    }
+
     return AudioConfig{
         .bitrate_kbps = bitrate,
+        .sample_rate = sample_rate,
+        .analysis_rate = analysis_rate,
+        .mix_from_channels = v["mix_from_channels"].value_or(true),
+        .mix_effects = v["mix_effects"].value_or(true),
+    };
+}
+
+CacheConfig load_cache_config(const toml::node_view<toml::node>& v) {
+    auto default_dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (!default_dir.isEmpty()) {
+        default_dir.append("/stems");
+    }
+
+    auto dir = QString::fromStdString(v["stem_cache_dir"].value_or<std::string>(""));
+    return CacheConfig{
+        .use_stem_cache = v["use_stem_cache"].value_or(false),
+        .stem_cache_dir = dir.isEmpty() ? default_dir : dir,
     };
 }
 
@@ -134,6 +161,7 @@ PersistentConfig load_config(const fs::path& load_path) {
         .path_config = load_path_config(paths),
         .video_config = load_video_config(table["video"]),
         .audio_config = load_audio_config(table["audio"]),
+        .cache_config = load_cache_config(table["cache"]),
     };
 }
 
@@ -167,6 +195,16 @@ bool save_config(const PersistentConfig& config, const fs::path& save_path) {
         {"audio",
          toml::table{
              {"bitrate", config.audio_config.bitrate_kbps},
+             {"sample_rate", config.audio_config.sample_rate},
+             {"analysis_rate", config.audio_config.analysis_rate},
+             {"mix_from_channels", config.audio_config.mix_from_channels},
+             {"mix_effects", config.audio_config.mix_effects},
+         }},
+
+        {"cache",
+         toml::table{
+             {"use_stem_cache", config.cache_config.use_stem_cache},
+             {"stem_cache_dir", config.cache_config.stem_cache_dir.toStdString()},
          }},
     };
 
@@ -1,6 +1,7 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <array>
 #include <filesystem>
 
 #include <QString>
@@ -37,14 +38,28 @@ struct VideoConfig {
     int h26x_crf;
 };
 
+// The rates offered in the options dialog
+inline constexpr std::array SAMPLE_RATES{44100, 48000, 96000};
+inline constexpr std::array ANALYSIS_RATES{0, 24000, 16000, 12000};
+
 struct AudioConfig {
     int bitrate_kbps;
+    int sample_rate;
+    int analysis_rate; // 0 for the full sample rate
+    bool mix_from_channels; // Build the audio track from the scopes' channel streams
+    bool mix_effects;       // Include the chorus/reverb buses in that mix
+};
+
+struct CacheConfig {
+    bool use_stem_cache;
+    QString stem_cache_dir;
 };
 
 struct PersistentConfig {
     PathConfig path_config;
     VideoConfig video_config;
     AudioConfig audio_config;
+    CacheConfig cache_config;
 };
 
 PersistentConfig load_config();
@@ -43,11 +43,14 @@ void PathChooser::set_icon(const QIcon& icon) {
 void PathChooser::open_file_chooser() {
     QString initial_dir = m_initial_dir;
     if (initial_dir.isEmpty() && !m_current_path.isEmpty()) {
-        initial_dir = QFileInfo(m_current_path).absoluteDir().path();
+        initial_dir = m_choose_dir ? m_current_path
+                                   : QFileInfo(m_current_path).absoluteDir().path();
     }
 
     QString filename =
-        QFileDialog::getOpenFileName(this, m_dialog_title, initial_dir, m_filter);
+        m_choose_dir
+            ? QFileDialog::getExistingDirectory(this, m_dialog_title, initial_dir)
+            : QFileDialog::getOpenFileName(this, m_dialog_title, initial_dir, m_filter);
     if (filename.isNull())
         return;
 
@@ -14,6 +14,7 @@ class PathChooser : public QWidget {
     Q_PROPERTY(QString filter READ filter WRITE set_filter)
     Q_PROPERTY(QIcon icon READ icon WRITE set_icon)
     Q_PROPERTY(QString dialog_title READ dialog_title WRITE set_dialog_title)
+    Q_PROPERTY(bool choose_dir READ choose_dir WRITE set_choose_dir)
 
 public:
     explicit PathChooser(QWidget* parent = nullptr);
@@ -27,6 +28,10 @@ public:
     QString filter() const { return m_filter; }
     void set_filter(const QString& filter) { m_filter = filter; }
 
+    // Whether to choose a directory rather than a file
+    bool choose_dir() const { return m_choose_dir; }
+    void set_choose_dir(bool choose_dir) { m_choose_dir = choose_dir; }
+
     QString initial_dir() const { return m_initial_dir; }
     void set_initial_dir(const QString& dir) { m_initial_dir = dir; }
 
@@ -47,6 +52,7 @@ private:
     QString m_dialog_title = "Choose File";
     QString m_filter = "";
     QString m_initial_dir = "";
+    bool m_choose_dir = false;
     QIcon m_icon;
 };
 
@@ -13,6 +13,8 @@
 #include <QList>
 #include <QMessageBox>
 
+#include <osmium.h>
+
 #include "config.h"
 #include "renderargs.h"
 #include "workers.h"
@@ -79,6 +81,9 @@ MainWindow::MainWindow(QWidget* parent)
     default_item->setData(0.75, toint(ChannelArgRole::PeakThreshold));
     default_item->setData(5.0, toint(ChannelArgRole::DriftWindowMs));
     default_item->setData(0.20, toint(ChannelArgRole::AvoidDriftBias));
+    default_item->setData(false, toint(ChannelArgRole::PitchTracking));
+    default_item->setData(0, toint(ChannelArgRole::MaxCandidates));
+    default_item->setData(false, toint(ChannelArgRole::TransientTrigger));
 
     default_item->setData(true, toint(ChannelArgRole::InheritDefaults));
     default_item->setData(true, toint(ChannelArgRole::IsVisible));
@@ -195,6 +200,18 @@ MainWindow::MainWindow(QWidget* parent)
                   ChannelArgRole::AvoidDriftBias,
                   &QDoubleSpinBox::valueChanged,
                   &QDoubleSpinBox::setValue);
+    bind_to_model<QCheckBox, bool>(ui->chbPitchTracking,
+                                   ChannelArgRole::PitchTracking,
+                                   &QCheckBox::clicked,
+                                   &QCheckBox::setChecked);
+    bind_to_model(ui->sbMaxCandidates,
+                  ChannelArgRole::MaxCandidates,
+                  &QSpinBox::valueChanged,
+                  &QSpinBox::setValue);
+    bind_to_model<QCheckBox, bool>(ui->chbTransientTrigger,
+                                   ChannelArgRole::TransientTrigger,
+                                   &QCheckBox::clicked,
+                                   &QCheckBox::setChecked);
 
     reinit_channel_model(16); // DEBUG
 
@@ -257,6 +274,33 @@ MainWindow::MainWindow(QWidget* parent)
             &controls::Previewer::clear_pixmap);
 
     m_render_thread.start();
+
+    // Set up analysis thread
+    m_a_worker = new AnalysisWorker();
+    m_a_worker->moveToThread(&m_analysis_thread);
+
+    connect(
+        this, &MainWindow::analysis_start_requested, m_a_worker, &AnalysisWorker::work);
+    connect(
+        this, &MainWindow::auto_tune_requested, m_a_worker, &AnalysisWorker::auto_tune);
+    // The worker's thread is busy until the analysis ends, so stop it directly
+    connect(ui->btnStopRender,
+            &QPushButton::clicked,
+            m_a_worker,
+            &AnalysisWorker::request_stop,
+            Qt::DirectConnection);
+    connect(m_a_worker,
+            &AnalysisWorker::progress_changed,
+            ui->progressBar,
+            &QProgressBar::setValue);
+    connect(m_a_worker, &AnalysisWorker::done, this, &MainWindow::handle_render_stop);
+    connect(m_a_worker,
+            &AnalysisWorker::tuning_done,
+            this,
+            &MainWindow::handle_tuning_done);
+    connect(&m_analysis_thread, &QThread::finished, m_a_worker, &QObject::deleteLater);
+
+    m_analysis_thread.start();
 }
 
 MainWindow::~MainWindow() {
@@ -267,6 +311,10 @@ MainWindow::~MainWindow() {
 
     m_render_thread.quit();
     m_render_thread.wait();
+
+    m_a_worker->request_stop();
+    m_analysis_thread.quit();
+    m_analysis_thread.wait();
 }
 
 void MainWindow::reinit_channel_model(int num_channels) {
@@ -315,46 +363,27 @@ void MainWindow::set_ui_state(UiState state) {
 // -- MainWindow slots --
 
 void MainWindow::start_rendering() {
+    render(false);
+}
+
+void MainWindow::start_draft_rendering() {
+    render(true);
+}
+
+void MainWindow::render(bool draft) {
     if (m_state != UiState::Editing)
         return;
 
-    if (m_input_file.isEmpty()) {
-        QMessageBox::warning(this, "Error", "Please choose a file to render.");
+    if (!check_input_files())
         return;
-    }
 
     const auto& soundfont_path = m_config.path_config.soundfont_path;
     const auto& ffmpeg_path = m_config.path_config.ffmpeg_path;
     bool use_system_ffmpeg = m_config.path_config.use_system_ffmpeg;
 
-    if (soundfont_path.isEmpty()) {
-        QMessageBox::warning(this,
-                             "Error",
-                             "You have not chosen a soundfont to use. Specify a "
-                             "soundfont in the Program Options menu.");
-        return;
-    }
-
-    if (!std::filesystem::is_regular_file(m_input_file.toStdString())) {
-        QString message = QString("The file \"%1\" does not exist or is not a regular "
-                                  "file. Please choose a new file.")
-                              .arg(m_input_file);
-        QMessageBox::warning(this, "Error", message);
-        set_input_file("");
-        return;
-    }
-
-    if (!std::filesystem::is_regular_file(soundfont_path.toStdString())) {
-        QString message =
-            QString("The file \"%1\" does not exist or is not a regular file. Please "
-                    "choose a new soundfont in the Program Options menu.")
-                .arg(soundfont_path);
-        QMessageBox::warning(this, "Error", message);
-        return;
-    }
-
-    auto outfile_name =
-        std::filesystem::path(m_input_file.toStdString()).stem().concat(".mp4");
+    auto outfile_name = std::filesystem::path(m_input_file.toStdString())
+                            .stem()
+                            .concat(draft ? "-draft.mp4" : ".mp4");
     auto outfile_path =
         std::filesystem::path(m_config.path_config.output_file_dir.toStdString())
         / outfile_name;
@@ -369,6 +398,11 @@ void MainWindow::start_rendering() {
 
     auto global_args = create_global_args();
     auto channel_args_list = create_channel_args();
+    if (draft) {
+        apply_draft_preset(global_args, channel_args_list);
+    }
+    if (!check_analysis_rate(global_args))
+        return;
 
     set_ui_state(UiState::Rendering);
     emit worker_start_requested(m_input_file,
@@ -379,6 +413,65 @@ void MainWindow::start_rendering() {
                                 global_args);
 }
 
+void MainWindow::start_analysis() {
+    if (m_state != UiState::Editing)
+        return;
+
+    if (!check_input_files())
+        return;
+
+    auto global_args = create_global_args();
+    auto channel_args_list = create_channel_args();
+    if (!check_analysis_rate(global_args))
+        return;
+
+    set_ui_state(UiState::Rendering);
+    emit analysis_start_requested(m_input_file,
+                                  m_config.path_config.soundfont_path,
+                                  channel_args_list,
+                                  global_args);
+}
+
+void MainWindow::start_auto_tune() {
+    if (m_state != UiState::Editing)
+        return;
+
+    if (!check_input_files())
+        return;
+
+    auto global_args = create_global_args();
+    auto channel_args_list = create_channel_args();
+    if (!check_analysis_rate(global_args))
+        return;
+
+    set_ui_state(UiState::Rendering);
+    emit auto_tune_requested(m_input_file,
+                             m_config.path_config.soundfont_path,
+                             channel_args_list,
+                             global_args);
+}
+
+void MainWindow::handle_tuning_done(const QList<ChannelArgs>& tuned_args,
+                                    const QString& report) {
+    set_ui_state(UiState::Editing);
+
+    QMessageBox mbox(QMessageBox::Question,
+                     "Osmium",
+                     report + "<br>Use the best settings for these channels?",
+                     QMessageBox::StandardButton::Yes | QMessageBox::StandardButton::No,
+                     this);
+    mbox.setTextFormat(Qt::RichText);
+    if (mbox.exec() != QMessageBox::StandardButton::Yes)
+        return;
+
+    for (const auto& args : tuned_args) {
+        set_trigger_args(args);
+    }
+
+    emit current_item_changed(m_channel_model.item(m_current_index));
+    update_channel_opts_enabled();
+}
+
 void MainWindow::handle_render_stop(bool ok, const QString& message) {
     if (!message.isEmpty()) {
         qDebug() << message;
@@ -524,6 +617,90 @@ void MainWindow::bind_to_model(Control* control,
             control_setter(role, control, setter));
 }
 
+void MainWindow::set_trigger_args(const ChannelArgs& args) {
+    int index = args.channel_number + 1;
+    auto* item = m_channel_model.item(index);
+
+    // Give the channel its own copy of the defaults before changing any of them
+    if (item->data(toint(ChannelArgRole::InheritDefaults)).toBool()) {
+        auto* own_item = m_channel_model.item(0)->clone();
+        own_item->setText(item->text());
+        own_item->setData(false, toint(ChannelArgRole::InheritDefaults));
+        own_item->setData(item->data(toint(ChannelArgRole::IsVisible)),
+                          toint(ChannelArgRole::IsVisible));
+        m_channel_model.setItem(index, own_item);
+        item = own_item;
+    }
+
+    item->setData(args.trigger_threshold, toint(ChannelArgRole::TriggerThreshold));
+    item->setData(args.max_nudge_ms, toint(ChannelArgRole::MaxNudgeMs));
+    item->setData(args.similarity_bias, toint(ChannelArgRole::SimilarityBias));
+    item->setData(args.similarity_window_ms, toint(ChannelArgRole::SimilarityWindowMs));
+    item->setData(args.peak_bias, toint(ChannelArgRole::PeakBias));
+    item->setData(args.peak_threshold, toint(ChannelArgRole::PeakThreshold));
+    item->setData(args.drift_window_ms, toint(ChannelArgRole::DriftWindowMs));
+    item->setData(args.avoid_drift_bias, toint(ChannelArgRole::AvoidDriftBias));
+    item->setData(args.transient_trigger, toint(ChannelArgRole::TransientTrigger));
+    item->setData(args.pitch_tracking, toint(ChannelArgRole::PitchTracking));
+}
+
+bool MainWindow::check_input_files() {
+    if (m_input_file.isEmpty()) {
+        QMessageBox::warning(this, "Error", "Please choose a file to render.");
+        return false;
+    }
+
+    const auto& soundfont_path = m_config.path_config.soundfont_path;
+    if (soundfont_path.isEmpty()) {
+        QMessageBox::warning(this,
+                             "Error",
+                             "You have not chosen a soundfont to use. Specify a "
+                             "soundfont in the Program Options menu.");
+        return false;
+    }
+
+    if (!std::filesystem::is_regular_file(m_input_file.toStdString())) {
+        QString message = QString("The file \"%1\" does not exist or is not a regular "
+                                  "file. Please choose a new file.")
+                              .arg(m_input_file);
+        QMessageBox::warning(this, "Error", message);
+        set_input_file("");
+        return false;
+    }
+
+    if (!std::filesystem::is_regular_file(soundfont_path.toStdString())) {
+        QString message =
+            QString("The file \"%1\" does not exist or is not a regular file. Please "
+                    "choose a new soundfont in the Program Options menu.")
+                .arg(soundfont_path);
+        QMessageBox::warning(this, "Error", message);
+        return false;
+    }
+
+    return true;
+}
+
+bool MainWindow::check_analysis_rate(const GlobalArgs& global_args) {
+    if (global_args.analysis_rate <= 0)
+        return true;
+
+    uint32_t factor = osmium::decimation_factor(global_args.sample_rate,
+                                                global_args.fps,
+                                                global_args.analysis_rate);
+    if (factor > 1)
+        return true;
+
+    QString message =
+        QString("An analysis rate of %1 kHz can't be used at a sample rate of %2 kHz "
+                "and %3 fps, so the scopes will be analyzed at the full sample rate. "
+                "Continue anyway?")
+            .arg(global_args.analysis_rate / 1000.0)
+            .arg(global_args.sample_rate / 1000.0)
+            .arg(global_args.fps);
+    auto button = QMessageBox::question(this, "Osmium", message);
+    return button == QMessageBox::StandardButton::Yes;
+}
+
 GlobalArgs MainWindow::create_global_args() {
     auto channel_order = static_cast<ChannelOrder>(ui->bgrpCellOrder->checkedId());
 
@@ -540,10 +717,19 @@ GlobalArgs MainWindow::create_global_args() {
         .crf = m_config.video_config.h26x_crf,
 
         .bitrate_kbps = m_config.audio_config.bitrate_kbps,
+        .sample_rate = m_config.audio_config.sample_rate,
+        .analysis_rate = m_config.audio_config.analysis_rate,
+        .max_voices = 0,
+        .mix_from_channels = m_config.audio_config.mix_from_channels,
+        .mix_effects = m_config.audio_config.mix_effects,
+        .stem_cache_dir = m_config.cache_config.use_stem_cache
+                              ? m_config.cache_config.stem_cache_dir
+                              : QString(),
 
         .border_color = ui->cpGridlineColor->color().rgb(),
         .border_thickness = ui->dsbGridlineThickness->value(),
         .background_color = ui->cpBackground->color().rgb(),
+        .antialiasing = true,
         .debug_vis = false,
     };
 }
@@ -607,5 +793,8 @@ ChannelArgs MainWindow::create_channel_args(QStandardItem* args, int index) {
         .peak_threshold = args->data(toint(ChannelArgRole::PeakThreshold)).toDouble(),
         .drift_window_ms = args->data(toint(ChannelArgRole::DriftWindowMs)).toDouble(),
         .avoid_drift_bias = args->data(toint(ChannelArgRole::AvoidDriftBias)).toDouble(),
+        .pitch_tracking = args->data(toint(ChannelArgRole::PitchTracking)).toBool(),
+        .max_candidates = args->data(toint(ChannelArgRole::MaxCandidates)).toInt(),
+        .transient_trigger = args->data(toint(ChannelArgRole::TransientTrigger)).toBool(),
     };
 }
@@ -41,6 +41,9 @@ enum class ChannelArgRole {
     PeakThreshold,
     DriftWindowMs,
     AvoidDriftBias,
+    PitchTracking,
+    MaxCandidates,
+    TransientTrigger,
 
     InheritDefaults,
     IsVisible,
@@ -65,6 +68,10 @@ public:
 
 public slots:
     void start_rendering();
+    void start_draft_rendering();
+    void start_analysis();
+    void start_auto_tune();
+    void handle_tuning_done(const QList<ChannelArgs>& tuned_args, const QString& report);
     void handle_render_stop(bool, const QString&);
 
     void set_input_file(const QString&);
@@ -84,6 +91,8 @@ private:
 
     RenderWorker* m_r_worker;
     QThread m_render_thread;
+    AnalysisWorker* m_a_worker;
+    QThread m_analysis_thread;
 
     QStandardItemModel m_channel_model;
     int m_current_index = -1;
@@ -123,6 +132,22 @@ private:
                        void (Control::*notifier)(T),
                        void (Control::*setter)(T));
 
+    /** Checks that the input file and soundfont exist, telling the user if not. */
+    bool check_input_files();
+
+    /** Checks that the analysis rate can be used at the render's sample and frame rates,
+     *  and if not, asks the user whether to go on at the full rate.
+     */
+    bool check_analysis_rate(const GlobalArgs& global_args);
+
+    /** Asks where to save the video and starts rendering it, with the draft preset if
+     *  `draft` is set.
+     */
+    void render(bool draft);
+
+    /** Stores the trigger settings in `args` in the item for its channel. */
+    void set_trigger_args(const ChannelArgs& args);
+
     GlobalArgs create_global_args();
     QList<ChannelArgs> create_channel_args();
     ChannelArgs create_channel_args(QStandardItem*, int);
@@ -134,6 +159,14 @@ signals:
                                 const QString& ffmpeg_path,
                                 const QList<ChannelArgs>&,
                                 const GlobalArgs&);
+    void analysis_start_requested(const QString& input_file,
+                                  const QString& soundfont,
+                                  const QList<ChannelArgs>&,
+                                  const GlobalArgs&);
+    void auto_tune_requested(const QString& input_file,
+                             const QString& soundfont,
+                             const QList<ChannelArgs>&,
+                             const GlobalArgs&);
 
     void current_item_changed(const QStandardItem* item);
 };
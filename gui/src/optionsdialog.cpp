@@ -18,6 +18,14 @@ OptionsDialog::OptionsDialog(QWidget* parent)
     ui->pcFfmpegPath->set_filter("Executables (*.exe);;All files (*.*)");
 #endif
 
+    for (int rate : SAMPLE_RATES) {
+        ui->cmbSampleRate->addItem(QString("%1 kHz").arg(rate / 1000.0), rate);
+    }
+    for (int rate : ANALYSIS_RATES) {
+        auto label = rate > 0 ? QString("%1 kHz").arg(rate / 1000.0) : "Full rate";
+        ui->cmbAnalysisRate->addItem(label, rate);
+    }
+
     ui->lbFfmpegFound->hide();
     ui->lbFfmpegNotFound->hide();
 
@@ -57,6 +65,13 @@ void OptionsDialog::set_config(const PersistentConfig& config) {
     ui->sbCrf->setValue(config.video_config.h26x_crf);
 
     ui->sbAudioBitrate->setValue(config.audio_config.bitrate_kbps);
+    ui->cmbSampleRate->setCurrentIndex(
+        ui->cmbSampleRate->findData(config.audio_config.sample_rate));
+    ui->cmbAnalysisRate->setCurrentIndex(
+        ui->cmbAnalysisRate->findData(config.audio_config.analysis_rate));
+
+    ui->cbUseStemCache->setChecked(config.cache_config.use_stem_cache);
+    ui->pcStemCacheDir->set_current_path(config.cache_config.stem_cache_dir);
 }
 
 PersistentConfig OptionsDialog::get_config() {
@@ -75,6 +90,11 @@ void OptionsDialog::update_config() {
     m_config.video_config.h26x_crf = ui->sbCrf->value();
 
     m_config.audio_config.bitrate_kbps = ui->sbAudioBitrate->value();
+    m_config.audio_config.sample_rate = ui->cmbSampleRate->currentData().toInt();
+    m_config.audio_config.analysis_rate = ui->cmbAnalysisRate->currentData().toInt();
+
+    m_config.cache_config.use_stem_cache = ui->cbUseStemCache->isChecked();
+    m_config.cache_config.stem_cache_dir = ui->pcStemCacheDir->current_path();
 }
 
 void OptionsDialog::enable_ffmpeg_check_timer(bool enable) {
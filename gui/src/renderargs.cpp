@@ -0,0 +1,51 @@
+#include "renderargs.h"
+
+#include <algorithm>
+
+#include <QFont>
+#include <QList>
+
+#include "config.h"
+
+namespace {
+
+constexpr int DRAFT_SAMPLE_RATE = 48000;
+constexpr int DRAFT_VOICES = 32;
+constexpr int DRAFT_MAX_FPS = 30;
+constexpr int DRAFT_ANALYSIS_RATE = 12000;
+
+// Half of `size`, rounded down to an even number as yuv420p needs
+int half_size(int size) {
+    return std::max(2, size / 4 * 2);
+}
+
+} // namespace
+
+void apply_draft_preset(GlobalArgs& global_args, QList<ChannelArgs>& channel_args) {
+    global_args.width = half_size(global_args.width);
+    global_args.height = half_size(global_args.height);
+    global_args.border_thickness /= 2;
+    global_args.fps = std::min(global_args.fps, DRAFT_MAX_FPS);
+
+    global_args.vid_codec = VideoCodec::H264;
+    global_args.h26x_preset = H26xPreset::UltraFast;
+
+    global_args.sample_rate = std::min(global_args.sample_rate, DRAFT_SAMPLE_RATE);
+    global_args.max_voices = DRAFT_VOICES;
+    int analysis_rate = global_args.analysis_rate;
+    global_args.analysis_rate = analysis_rate == 0
+                                    ? DRAFT_ANALYSIS_RATE
+                                    : std::min(analysis_rate, DRAFT_ANALYSIS_RATE);
+    global_args.antialiasing = false;
+
+    // Scale the lines and labels down with the frame, so it still looks like the render
+    for (auto& args : channel_args) {
+        args.thickness /= 2;
+        args.midline_thickness /= 2;
+        if (args.label_font.pointSizeF() > 0) {
+            args.label_font.setPointSizeF(args.label_font.pointSizeF() / 2);
+        } else if (args.label_font.pixelSize() > 0) {
+            args.label_font.setPixelSize(std::max(1, args.label_font.pixelSize() / 2));
+        }
+    }
+}
@@ -2,6 +2,7 @@
 #define RENDERARGS_H
 
 #include <QFont>
+#include <QList>
 #include <QObject>
 #include <QRgb>
 
@@ -22,10 +23,17 @@ struct GlobalArgs {
     int crf;
 
     int bitrate_kbps;
+    int sample_rate;
+    int analysis_rate; // 0 to analyze the scopes at the full sample rate
+    int max_voices;    // 0 for BASSMIDI's default
+    bool mix_from_channels;
+    bool mix_effects;
+    QString stem_cache_dir; // Empty if the stem cache is disabled
 
     QRgb border_color;
     double border_thickness;
     QRgb background_color;
+    bool antialiasing;
     bool debug_vis;
 };
 
@@ -56,8 +64,19 @@ struct ChannelArgs {
     double peak_threshold;
     double drift_window_ms;
     double avoid_drift_bias;
+    bool pitch_tracking;
+    int max_candidates;
+    bool transient_trigger;
 };
 
+/** Turns the settings for a render into ones for a quick, rough preview of it: half the
+ *  resolution, at most 30 fps, H.264 at its fastest preset (whatever codec was chosen),
+ *  cheaper synthesis, an analysis rate of at most 12 kHz and no antialiasing. Trigger
+ *  settings are left alone, but the lower rates change what each frame sees, so the
+ *  preview only roughly shows how the render will trigger.
+ */
+void apply_draft_preset(GlobalArgs& global_args, QList<ChannelArgs>& channel_args);
+
 Q_DECLARE_METATYPE(GlobalArgs)
 Q_DECLARE_METATYPE(ChannelArgs)
 
@@ -1,9 +1,12 @@
 #include "scoperenderer.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <memory>
 #include <numbers>
 #include <numeric>
+#include <optional>
 #include <vector>
 
 #include <QPainter>
@@ -17,6 +20,49 @@
 
 #include "instrumentnames.h"
 
+namespace {
+
+// Each scope decodes up to a second ahead on its own thread, half a second at a time
+constexpr int READ_AHEAD_MS = 1000;
+
+} // namespace
+
+osmium::ScopeBuilder make_scope_builder(const ChannelArgs& args,
+                                        const GlobalArgs& global_args,
+                                        const osmium::EventTracker& events) {
+    std::optional<osmium::NoteTracker> note_tracker;
+    if (args.pitch_tracking) {
+        note_tracker.emplace(
+            events.get_all_events(), events.get_event_times(), args.channel_number);
+    }
+
+    auto engine = args.transient_trigger ? osmium::TriggerEngine::Transient
+                                         : osmium::TriggerEngine::Search;
+
+    osmium::ScopeBuilder builder;
+    builder.amplification(args.amplification)
+        .analysis_rate(global_args.analysis_rate)
+        .avoid_drift_bias(args.avoid_drift_bias)
+        .display_window_ms(args.scope_width_ms)
+        .drift_window(args.drift_window_ms)
+        .frame_rate(global_args.fps)
+        .max_candidates(args.max_candidates)
+        .max_nudge_ms(args.max_nudge_ms)
+        .note_tracker(note_tracker)
+        .peak_bias(args.peak_bias)
+        .peak_threshold(args.peak_threshold)
+        .read_ahead_ms(READ_AHEAD_MS)
+        .similarity_bias(args.similarity_bias)
+        .similarity_window_ms(args.similarity_window_ms)
+        .stereo(args.is_stereo)
+        .trigger_cache_dir(global_args.stem_cache_dir.toStdString())
+        .trigger_engine(engine)
+        .trigger_threshold(args.trigger_threshold);
+    return builder;
+}
+
+// -- BaseRenderer --
+
 BaseRenderer::BaseRenderer(const QList<ChannelArgs>& channel_args,
                            const GlobalArgs& global_args)
     : m_width(global_args.width),
@@ -195,38 +241,30 @@ void BaseRenderer::PaintInfo::update_label(const ChannelArgs& args) {
 
 // -- ScopeRenderer --
 
-ScopeRenderer::ScopeRenderer(const QString& filename,
-                             const QString& soundfont,
+ScopeRenderer::ScopeRenderer(const std::shared_ptr<osmium::MidiSynth>& synth,
                              const QList<ChannelArgs>& channel_args,
                              const GlobalArgs& global_args)
     : BaseRenderer(channel_args, global_args),
-      m_event_tracker(filename.toUtf8(), global_args.fps) {
-    for (int i = 0; i < channel_args.size(); i++) {
-        const auto& args = channel_args[i];
-        auto scope = osmium::ScopeBuilder()
-                         .amplification(args.amplification)
-                         .avoid_drift_bias(args.avoid_drift_bias)
-                         .display_window_ms(args.scope_width_ms)
-                         .drift_window(args.drift_window_ms)
-                         .frame_rate(global_args.fps)
-                         .max_nudge_ms(args.max_nudge_ms)
-                         .peak_bias(args.peak_bias)
-                         .peak_threshold(args.peak_threshold)
-                         .similarity_bias(args.similarity_bias)
-                         .similarity_window_ms(args.similarity_window_ms)
-                         .soundfonts({soundfont.toStdString()})
-                         .stereo(args.is_stereo)
-                         .trigger_threshold(args.trigger_threshold)
-                         .build_from_midi_channel(filename.toUtf8(), args.channel_number);
+      m_antialiasing(global_args.antialiasing),
+      m_event_tracker(synth->get_document(), global_args.fps) {
+    // Every scope reads its channel from the shared synth, and the events come from the
+    // file it already parsed
+    for (const auto& args : channel_args) {
+        auto scope = make_scope_builder(args, global_args, m_event_tracker)
+                         .build_from_synth(synth, args.channel_number);
         m_scopes.emplace_back(std::move(scope));
     }
+    m_stats_collectors.resize(m_scopes.size());
 }
 
 QImage ScopeRenderer::paint_next_frame() {
     // Update events (for tracking instrument changes)
     m_event_tracker.next_events();
 
-    auto render_hints = QPainter::Antialiasing | QPainter::TextAntialiasing;
+    QPainter::RenderHints render_hints;
+    if (m_antialiasing) {
+        render_hints = QPainter::Antialiasing | QPainter::TextAntialiasing;
+    }
 
     // Run each subimage in parallel
     std::vector<int> indices(m_scopes.size());
@@ -274,10 +312,28 @@ QImage ScopeRenderer::paint_next_frame() {
     return full_frame;
 }
 
+void ScopeRenderer::analyze_next_frame() {
+    using clock = std::chrono::steady_clock;
+
+    std::vector<int> indices(m_scopes.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    QtConcurrent::blockingMap(indices, [this](int idx) {
+        auto start = clock::now();
+        m_scopes[idx].next_wave_data();
+        m_stats_collectors[idx].add_frame(m_scopes[idx], clock::now() - start);
+    });
+}
+
 bool ScopeRenderer::has_frames_remaining() const {
     return std::ranges::any_of(m_scopes, &osmium::Scope::is_playing);
 }
 
+void ScopeRenderer::save_trigger_tracks() {
+    for (auto& scope : m_scopes) {
+        scope.flush_trigger_track();
+    }
+}
+
 double ScopeRenderer::get_progress() {
     double acc = 0.0;
     for (const auto& scope : m_scopes) {
@@ -287,6 +343,14 @@ double ScopeRenderer::get_progress() {
     return acc / m_scopes.size();
 }
 
+std::vector<osmium::TriggerStats> ScopeRenderer::get_trigger_stats() const {
+    std::vector<osmium::TriggerStats> stats;
+    for (const auto& collector : m_stats_collectors) {
+        stats.push_back(collector.summarize());
+    }
+    return stats;
+}
+
 const std::vector<float>& ScopeRenderer::get_left_wave(int index) const {
     return m_scopes[index].get_left_samples();
 }
@@ -1,6 +1,7 @@
 #ifndef SCOPERENDERER_H
 #define SCOPERENDERER_H
 
+#include <memory>
 #include <vector>
 
 #include <QColor>
@@ -14,6 +15,13 @@
 
 #include "renderargs.h"
 
+/** A builder with all of a channel's scope settings. `events` supplies the notes for
+ *  pitch tracking.
+ */
+osmium::ScopeBuilder make_scope_builder(const ChannelArgs& args,
+                                        const GlobalArgs& global_args,
+                                        const osmium::EventTracker& events);
+
 class BaseRenderer : public QObject {
     Q_OBJECT
 public:
@@ -64,20 +72,34 @@ protected:
 
 class ScopeRenderer : public BaseRenderer {
 public:
-    ScopeRenderer(const QString& filename,
-                  const QString& soundfont,
+    ScopeRenderer(const std::shared_ptr<osmium::MidiSynth>& synth,
                   const QList<ChannelArgs>& channel_args,
                   const GlobalArgs& global_args);
     ScopeRenderer(const ScopeRenderer&) = delete;
     ScopeRenderer& operator=(const ScopeRenderer&) = delete;
 
     QImage paint_next_frame();
+    /** Advances every scope by one frame without painting anything, and records how
+     *  each one triggered.
+     */
+    void analyze_next_frame();
     bool has_frames_remaining() const;
     double get_progress();
+    /** Saves the trigger tracks of the scopes that played to the end, so later renders
+     *  can replay them. Call once the frames are done.
+     */
+    void save_trigger_tracks();
+
+    /** Trigger statistics for each channel over the frames passed to
+     *  `analyze_next_frame()` so far.
+     */
+    std::vector<osmium::TriggerStats> get_trigger_stats() const;
 
 protected:
+    bool m_antialiasing;
     osmium::EventTracker m_event_tracker;
     std::vector<osmium::Scope> m_scopes;
+    std::vector<osmium::TriggerStatsCollector> m_stats_collectors;
 
     const std::vector<float>& get_left_wave(int index) const override;
     const std::vector<float>& get_right_wave(int index) const override;
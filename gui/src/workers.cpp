@@ -1,9 +1,13 @@
 #include "workers.h"
 #include "config.h"
 
+#include <algorithm>
 #include <chrono>
 #include <format>
+#include <memory>
 #include <random>
+#include <string>
+#include <vector>
 
 #include <QDebug>
 #include <QLocalServer>
@@ -12,6 +16,38 @@
 #include <QObject>
 #include <QString>
 
+namespace {
+
+std::shared_ptr<osmium::MidiSynth> make_synth(const QString& input_file,
+                                              const QString& soundfont,
+                                              const GlobalArgs& global_args) {
+    auto synth = std::make_shared<osmium::MidiSynth>(
+        input_file.toUtf8(),
+        std::vector<std::string>{soundfont.toStdString()},
+        false,
+        global_args.sample_rate,
+        osmium::SynthQuality{
+            .max_voices = static_cast<uint32_t>(global_args.max_voices),
+        });
+    if (!global_args.stem_cache_dir.isEmpty()) {
+        synth->enable_stem_cache(global_args.stem_cache_dir.toStdString());
+    }
+    return synth;
+}
+
+/** Loads the presets the song uses before synthesis starts, so it doesn't stall midway
+ *  to load them.
+ */
+void preload_soundfonts(osmium::MidiSynth& synth) {
+    auto report = synth.preload_soundfonts();
+    if (report.num_presets > 0) {
+        qDebug() << "Preloaded" << report.num_presets << "presets, skipping"
+                 << report.saved_bytes() / (1024 * 1024) << "MiB of unused samples";
+    }
+}
+
+} // namespace
+
 // -- AbstractSocketWorker --
 
 AbstractSocketWorker::AbstractSocketWorker(const QString& prefix, QObject* parent)
@@ -60,8 +96,7 @@ void AbstractSocketWorker::priv_on_connection() {
 
 VideoSocketWorker::VideoSocketWorker() : AbstractSocketWorker("osvid-") {}
 
-void VideoSocketWorker::init(const QString& filename,
-                             const QString& soundfont,
+void VideoSocketWorker::init(const std::shared_ptr<osmium::MidiSynth>& synth,
                              const QList<ChannelArgs>& channel_args,
                              const GlobalArgs& global_args) {
     m_width = global_args.width;
@@ -69,7 +104,7 @@ void VideoSocketWorker::init(const QString& filename,
     m_fps = global_args.fps;
 
     try {
-        m_renderer.emplace(filename, soundfont, channel_args, global_args);
+        m_renderer.emplace(synth, channel_args, global_args);
     } catch (const std::runtime_error& e) {
         m_renderer.reset();
         throw;
@@ -131,6 +166,7 @@ void VideoSocketWorker::handle_connection(QLocalSocket* connection) {
     qDebug() << "Total render time:" << std::format("{:%M:%S}", render_dur).c_str();
 
     connection->flush();
+    m_renderer->save_trigger_tracks();
     m_renderer.reset();
 
     emit done(true, m_abort_requested ? "Rendering aborted" : "");
@@ -146,10 +182,25 @@ uint32_t AudioSocketWorker::get_num_channels() {
     return m_player->get_num_channels();
 }
 
-void AudioSocketWorker::init(const QString& filename, const QString& soundfont, int fps) {
-    m_filename = filename;
+uint32_t AudioSocketWorker::get_sample_rate() {
+    if (!m_player.has_value())
+        return 0;
+    return m_player->get_sample_rate();
+}
+
+void AudioSocketWorker::init(const std::shared_ptr<osmium::MidiSynth>& synth,
+                             const GlobalArgs& global_args) {
     try {
-        m_player.emplace(m_filename.toUtf8(), fps, soundfont.toUtf8());
+        if (global_args.mix_from_channels) {
+            // Mix down the channel streams the scopes read from; no extra synthesis
+            m_player.emplace(synth, global_args.fps, global_args.mix_effects);
+        } else {
+            // The synth's own mix (or its cached master stem), so the song isn't parsed
+            // and synthesized a second time just for the audio track
+            m_player.emplace(std::make_unique<osmium::SynthChannelSource>(
+                                 synth, osmium::MidiSynth::MASTER_MIX),
+                             global_args.fps);
+        }
     } catch (const std::runtime_error& e) {
         m_player.reset();
         throw;
@@ -249,8 +300,13 @@ void RenderWorker::work(const QString& input_file,
             lock.relock();
         }
 
-        m_vs_worker->init(input_file, soundfont, channel_args, global_args);
-        m_as_worker->init(input_file, soundfont, global_args.fps);
+        // Parse and synthesize the song once for both the scopes and the audio track.
+        // Every reader has to be registered before either worker starts reading.
+        auto synth = make_synth(input_file, soundfont, global_args);
+
+        m_vs_worker->init(synth, channel_args, global_args);
+        m_as_worker->init(synth, global_args);
+        preload_soundfonts(*synth);
 
         if (ffmpeg_path.isNull()) {
             m_ffmpeg.setProgram("ffmpeg");
@@ -306,7 +362,8 @@ QStringList RenderWorker::get_ffmpeg_args() {
                          << QString("%1x%2").arg(width).arg(height) << "-i"
                          << m_video_server_path
                          // input audio format
-                         << "-f" << "f32le" << "-sample_rate" << QString::number(48000)
+                         << "-f" << "f32le" << "-sample_rate"
+                         << QString::number(m_as_worker->get_sample_rate())
                          << "-ac" << QString::number(m_as_worker->get_num_channels())
                          << "-i"
                          << m_audio_server_path
@@ -389,3 +446,232 @@ void RenderWorker::notify_ffmpeg_error(QProcess::ProcessError err) {
         m_state = State::Idle;
     }
 }
+
+// -- AnalysisWorker --
+
+namespace {
+
+QString format_trigger_report(const QList<ChannelArgs>& channel_args,
+                              const std::vector<osmium::TriggerStats>& stats,
+                              int num_frames,
+                              std::chrono::milliseconds elapsed) {
+    QString report = QString("Analyzed %1 frames in %2 s.<br><br>")
+                         .arg(num_frames)
+                         .arg(elapsed.count() / 1000.0, 0, 'f', 1);
+
+    report += "<table cellpadding=\"3\">"
+              "<tr><th>Channel</th><th>No trigger</th><th>Moved</th>"
+              "<th>Mean jump</th><th>Median jump</th><th>95% jump</th><th>Max jump</th>"
+              "<th>Mean cost</th><th>99% cost</th><th>Max cost</th></tr>";
+
+    auto percent = [](double rate) { return QString("%1%").arg(rate * 100, 0, 'f', 1); };
+    auto ms = [](double v) { return QString("%1 ms").arg(v, 0, 'f', 2); };
+    auto us = [](double v) { return QString("%1 \u00b5s").arg(v, 0, 'f', 0); };
+
+    bool any_replayed = false;
+    for (size_t i = 0; i < stats.size(); i++) {
+        const auto& s = stats[i];
+        QString channel = QString::number(channel_args[i].channel_number + 1);
+        if (s.replayed) {
+            channel += "*";
+            any_replayed = true;
+        }
+
+        report +=
+            QString("<tr><td>%1</td><td>%2</td><td>%3</td>")
+                .arg(channel, percent(s.no_nudge_rate()), percent(s.changed_rate()));
+        report += QString("<td>%1</td><td>%2</td><td>%3</td><td>%4</td>")
+                      .arg(ms(s.mean_change_ms),
+                           ms(s.median_change_ms),
+                           ms(s.p95_change_ms),
+                           ms(s.max_change_ms));
+        report += QString("<td>%1</td><td>%2</td><td>%3</td></tr>")
+                      .arg(us(s.mean_cost_us), us(s.p99_cost_us), us(s.max_cost_us));
+    }
+    report += "</table>";
+
+    report += "<br>\"Jump\" is how much the nudge changed from one frame to the next. "
+              "Cost includes reading the channel's audio.";
+    if (any_replayed) {
+        report += "<br>* Replayed from the trigger cache, so the costs don't reflect a "
+                  "real trigger search.";
+    }
+    return report;
+}
+
+// The settings auto-tuning tries, on the first minute of the song
+constexpr double TUNING_SECONDS = 60.0;
+constexpr size_t TUNING_CONFIGS = 32;
+constexpr uint64_t TUNING_SEED = 1;
+
+osmium::TriggerConfig trigger_config_from(const ChannelArgs& args) {
+    return osmium::TriggerConfig{
+        .trigger_threshold = args.trigger_threshold,
+        .max_nudge_ms = args.max_nudge_ms,
+        .similarity_window_ms = args.similarity_window_ms,
+        .similarity_bias = args.similarity_bias,
+        .peak_threshold = args.peak_threshold,
+        .peak_bias = args.peak_bias,
+        .drift_window = args.drift_window_ms,
+        .avoid_drift_bias = args.avoid_drift_bias,
+        .trigger_engine = args.transient_trigger ? osmium::TriggerEngine::Transient
+                                                 : osmium::TriggerEngine::Search,
+        .pitch_tracking = args.pitch_tracking,
+    };
+}
+
+void apply_trigger_config(ChannelArgs& args, const osmium::TriggerConfig& config) {
+    args.trigger_threshold = config.trigger_threshold;
+    args.max_nudge_ms = config.max_nudge_ms;
+    args.similarity_window_ms = config.similarity_window_ms;
+    args.similarity_bias = config.similarity_bias;
+    args.peak_threshold = config.peak_threshold;
+    args.peak_bias = config.peak_bias;
+    args.drift_window_ms = config.drift_window;
+    args.avoid_drift_bias = config.avoid_drift_bias;
+    args.transient_trigger = config.trigger_engine == osmium::TriggerEngine::Transient;
+    args.pitch_tracking = config.pitch_tracking;
+}
+
+/** The configurations to try on a channel: a random sample of the grid, plus the
+ *  channel's current settings so tuning can never make things worse.
+ */
+std::vector<osmium::TriggerConfig> tuning_configs(const ChannelArgs& args) {
+    osmium::TriggerGrid grid{
+        .trigger_thresholds = {0.05, 0.1, 0.2, 0.3},
+        .similarity_biases = {0.5, 1.0, 2.0},
+        .peak_biases = {0.0, 0.5, 1.0},
+        .trigger_engines = {osmium::TriggerEngine::Search,
+                            osmium::TriggerEngine::Transient},
+    };
+
+    auto current = trigger_config_from(args);
+    auto configs = grid.sample(current, TUNING_CONFIGS, TUNING_SEED);
+    configs.insert(configs.begin(), current);
+    return configs;
+}
+
+QString format_tuning_report(
+    const QList<ChannelArgs>& channel_args,
+    const std::vector<std::vector<osmium::SweepResult>>& results) {
+    QString report = QString("Tried %1 trigger settings per channel on the first %2 "
+                             "seconds of the song. Lower scores are steadier.<br><br>")
+                         .arg(TUNING_CONFIGS + 1)
+                         .arg(TUNING_SECONDS);
+
+    report += "<table cellpadding=\"3\">"
+              "<tr><th>Channel</th><th>Current</th><th>Best</th><th>Threshold</th>"
+              "<th>Similarity bias</th><th>Peak bias</th><th>Engine</th></tr>";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        // The current settings went first, so find where they ended up
+        const auto& channel_results = results[i];
+        auto current = trigger_config_from(channel_args[i]);
+        auto it =
+            std::ranges::find(channel_results, current, &osmium::SweepResult::config);
+        const auto& best = channel_results.front();
+
+        report += QString("<tr><td>%1</td><td>%2</td><td>%3</td>")
+                      .arg(channel_args[i].channel_number + 1)
+                      .arg(it != channel_results.end() ? it->score : 0.0, 0, 'f', 3)
+                      .arg(best.score, 0, 'f', 3);
+        report +=
+            QString("<td>%1</td><td>%2</td><td>%3</td><td>%4</td></tr>")
+                .arg(best.config.trigger_threshold)
+                .arg(best.config.similarity_bias)
+                .arg(best.config.peak_bias)
+                .arg(best.config.trigger_engine == osmium::TriggerEngine::Transient
+                         ? "Transient"
+                         : "Search");
+    }
+    report += "</table>";
+    return report;
+}
+
+} // namespace
+
+AnalysisWorker::AnalysisWorker(QObject* parent)
+    : QObject(parent),
+      m_abort_requested(false) {}
+
+void AnalysisWorker::work(const QString& input_file,
+                          const QString& soundfont,
+                          const QList<ChannelArgs>& channel_args,
+                          const GlobalArgs& global_args) {
+    using ms = std::chrono::milliseconds;
+    using clock = std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+
+    m_abort_requested = false;
+
+    try {
+        auto synth = make_synth(input_file, soundfont, global_args);
+        ScopeRenderer renderer(synth, channel_args, global_args);
+        preload_soundfonts(*synth);
+
+        int frame_counter = 0;
+        int progress_update_freq = std::max(1, global_args.fps / 2);
+        auto start = clock::now();
+        while (renderer.has_frames_remaining() && !m_abort_requested) {
+            renderer.analyze_next_frame();
+            if (frame_counter % progress_update_freq == 0) {
+                emit progress_changed(renderer.get_progress() * 1000);
+            }
+            frame_counter++;
+        }
+        auto elapsed = duration_cast<ms>(clock::now() - start);
+        renderer.save_trigger_tracks();
+
+        if (m_abort_requested) {
+            emit done(true, "Analysis aborted.");
+            return;
+        }
+        auto stats = renderer.get_trigger_stats();
+        emit done(true,
+                  format_trigger_report(channel_args, stats, frame_counter, elapsed));
+    } catch (const std::exception& e) {
+        emit done(false, QString(e.what()).toHtmlEscaped());
+    }
+}
+
+void AnalysisWorker::auto_tune(const QString& input_file,
+                               const QString& soundfont,
+                               const QList<ChannelArgs>& channel_args,
+                               const GlobalArgs& global_args) {
+    m_abort_requested = false;
+
+    try {
+        auto synth = make_synth(input_file, soundfont, global_args);
+        osmium::EventTracker events(synth->get_document(), global_args.fps);
+
+        std::vector<osmium::SweepChannel> channels;
+        for (const auto& args : channel_args) {
+            channels.push_back(osmium::SweepChannel{
+                .channel = args.channel_number,
+                .base = make_scope_builder(args, global_args, events),
+                .configs = tuning_configs(args),
+            });
+        }
+
+        osmium::SweepOptions options{
+            .max_seconds = TUNING_SECONDS,
+            .abort_requested = &m_abort_requested,
+            .on_progress =
+                [this](double progress) { emit progress_changed(progress * 1000); },
+        };
+        auto results = osmium::sweep_triggers(synth, channels, options);
+
+        if (m_abort_requested) {
+            emit done(true, "Auto-tune aborted.");
+            return;
+        }
+
+        QList<ChannelArgs> tuned_args = channel_args;
+        for (qsizetype i = 0; i < tuned_args.size(); i++) {
+            apply_trigger_config(tuned_args[i], results[i].front().config);
+        }
+        emit tuning_done(tuned_args, format_tuning_report(channel_args, results));
+    } catch (const std::exception& e) {
+        emit done(false, QString(e.what()).toHtmlEscaped());
+    }
+}
@@ -2,6 +2,7 @@
 #define WORKERS_H
 
 #include <atomic>
+#include <memory>
 #include <optional>
 
 #include <QLocalServer>
@@ -43,8 +44,7 @@ public:
     VideoSocketWorker();
 
 public slots:
-    void init(const QString& filename,
-              const QString& soundfont,
+    void init(const std::shared_ptr<osmium::MidiSynth>& synth,
               const QList<ChannelArgs>& channel_args,
               const GlobalArgs& global_args);
 
@@ -72,9 +72,11 @@ public:
     AudioSocketWorker();
 
     uint32_t get_num_channels();
+    uint32_t get_sample_rate();
 
 public slots:
-    void init(const QString& filename, const QString& soundfont, int fps);
+    void init(const std::shared_ptr<osmium::MidiSynth>& synth,
+              const GlobalArgs& global_args);
 
 signals:
     void ready();
@@ -85,7 +87,6 @@ protected:
     void handle_connection(QLocalSocket* connection) override;
 
 private:
-    QString m_filename;
     std::optional<osmium::Player> m_player;
 };
 
@@ -110,11 +111,11 @@ public slots:
     void request_stop();
 
 signals:
-    void init_video(const QString& input_file,
-                    const QString& soundfont,
+    void init_video(const std::shared_ptr<osmium::MidiSynth>& synth,
                     const QList<ChannelArgs>& channel_args,
                     const GlobalArgs& global_args);
-    void init_audio(const QString& filename, const QString& soundfont, int fps);
+    void init_audio(const std::shared_ptr<osmium::MidiSynth>& synth,
+                    const GlobalArgs& global_args);
     void error(const QString& msg);
     void progress_changed(int);
     void done(bool, const QString& msg);
@@ -145,4 +146,36 @@ private slots:
     void notify_ffmpeg_error(QProcess::ProcessError);
 };
 
+/** Runs the scopes of a render without painting or encoding anything, either to report
+ *  how steadily each channel triggers or to search for settings that trigger better.
+ *  Meant for tuning trigger settings without waiting for a full render.
+ */
+class AnalysisWorker : public QObject {
+    Q_OBJECT
+public:
+    AnalysisWorker(QObject* parent = nullptr);
+
+public slots:
+    void work(const QString& input_file,
+              const QString& soundfont,
+              const QList<ChannelArgs>& channel_args,
+              const GlobalArgs& global_args);
+    /** Tries a range of trigger settings on each channel, and reports the steadiest. */
+    void auto_tune(const QString& input_file,
+                   const QString& soundfont,
+                   const QList<ChannelArgs>& channel_args,
+                   const GlobalArgs& global_args);
+    // Called from other threads while `work()` is running, so connect it directly
+    void request_stop() { m_abort_requested = true; }
+
+signals:
+    void progress_changed(int);
+    void done(bool, const QString& msg);
+    /** `tuned_args` are copies of the channel args with the best trigger settings. */
+    void tuning_done(const QList<ChannelArgs>& tuned_args, const QString& report);
+
+private:
+    std::atomic<bool> m_abort_requested;
+};
+
 #endif // WORKERS_H
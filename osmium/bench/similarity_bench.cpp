@@ -0,0 +1,84 @@
+// Microbenchmark for osmium::sum_abs_diffs. Compares every SIMD level this machine
+// supports against the scalar kernel, and checks that their results are bit-identical.
+// Also times osmium::CrossCorrelator, which scores every offset at once via FFT.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <random>
+#include <vector>
+
+#include "similarity.h"
+
+using osmium::SimdLevel;
+
+namespace {
+
+// Defaults: a 40 ms similarity window at 48 kHz, with ~5 ms worth of candidate nudges
+constexpr uint32_t WINDOW = 1920;
+constexpr uint32_t OFFSETS = 240;
+constexpr int ITERATIONS = 2000;
+
+double time_level(SimdLevel level,
+                  const std::vector<float>& samples,
+                  const std::vector<float>& prev,
+                  std::vector<double>& out) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        osmium::sum_abs_diffs(
+            level, samples.data(), prev.data(), WINDOW, OFFSETS, out.data());
+    }
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / ITERATIONS;
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    std::vector<float> samples(WINDOW + OFFSETS);
+    std::vector<float> prev(WINDOW);
+    for (auto& f : samples) f = dist(rng);
+    for (auto& f : prev) f = dist(rng);
+
+    std::vector<double> reference(OFFSETS);
+    double scalar_us = time_level(SimdLevel::Scalar, samples, prev, reference);
+    std::printf("%-8s %10.2f us/call\n", osmium::to_string(SimdLevel::Scalar), scalar_us);
+
+    int rc = 0;
+    SimdLevel best = osmium::detect_simd_level();
+    for (auto level : {SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > best)
+            break;
+
+        std::vector<double> out(OFFSETS);
+        double us = time_level(level, samples, prev, out);
+        bool identical =
+            std::memcmp(out.data(), reference.data(), OFFSETS * sizeof(double)) == 0;
+        std::printf("%-8s %10.2f us/call  %5.2fx  %s\n",
+                    osmium::to_string(level),
+                    us,
+                    scalar_us / us,
+                    identical ? "bit-identical" : "MISMATCH");
+        if (!identical)
+            rc = 1;
+    }
+
+    osmium::CrossCorrelator correlator(WINDOW, OFFSETS);
+    std::vector<double> distances(OFFSETS);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        correlator.sum_squared_diffs(samples.data(), prev.data(), distances.data());
+    }
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    double fft_us = elapsed.count() / ITERATIONS;
+    std::printf("%-8s %10.2f us/call  %5.2fx\n", "FFT", fft_us, scalar_us / fft_us);
+
+    return rc;
+}
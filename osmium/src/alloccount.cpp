@@ -0,0 +1,61 @@
+#include "alloccount.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace osmium {
+
+#ifdef OSMIUM_COUNT_ALLOCATIONS
+
+namespace {
+thread_local uint64_t t_allocation_count = 0;
+} // namespace
+
+uint64_t thread_allocation_count() {
+    return t_allocation_count;
+}
+
+} // namespace osmium
+
+// The replacements have to live in the same translation unit as
+// thread_allocation_count(), so that the linker pulls them out of the static library
+// whenever the counter is used.
+
+void* operator new(std::size_t size) {
+    osmium::t_allocation_count++;
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t /*size*/) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t /*size*/) noexcept {
+    std::free(p);
+}
+
+#else
+
+uint64_t thread_allocation_count() {
+    return 0;
+}
+
+} // namespace osmium
+
+#endif // OSMIUM_COUNT_ALLOCATIONS
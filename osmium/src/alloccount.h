@@ -0,0 +1,18 @@
+#ifndef ALLOCCOUNT_H
+#define ALLOCCOUNT_H
+
+#include <cstdint>
+
+namespace osmium {
+
+/** Returns the number of heap allocations made so far by the calling thread.
+ *
+ *  Allocations are only counted when OsmiumLib is built with OSMIUM_COUNT_ALLOCATIONS,
+ *  which replaces the global `operator new` for the entire program. Otherwise this always
+ *  returns 0.
+ */
+uint64_t thread_allocation_count();
+
+} // namespace osmium
+
+#endif // ALLOCCOUNT_H
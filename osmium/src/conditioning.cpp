@@ -0,0 +1,402 @@
+#include "conditioning.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+
+#include "similarity.h"
+#include "simd.h"
+
+namespace osmium {
+
+namespace {
+
+constexpr float LOWEST = -std::numeric_limits<float>::infinity();
+
+// Every kernel processes as many whole vectors' worth of frames as it can, folds their
+// peak into `peak`, and returns how many frames it did. The scalar loops finish the rest.
+
+#ifdef OSMIUM_X86
+
+uint32_t deinterleave_stereo_sse2(const float* data,
+                                  uint32_t num_frames,
+                                  float* left,
+                                  float* right,
+                                  float* mix,
+                                  float& peak) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128 max = _mm_set1_ps(peak);
+
+    uint32_t i = 0;
+    for (; i + 4 <= num_frames; i += 4) {
+        __m128 a = _mm_loadu_ps(data + 2 * i);     // l0 r0 l1 r1
+        __m128 b = _mm_loadu_ps(data + 2 * i + 4); // l2 r2 l3 r3
+        __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 m = _mm_mul_ps(_mm_add_ps(l, r), half);
+
+        _mm_storeu_ps(left + i, l);
+        _mm_storeu_ps(right + i, r);
+        _mm_storeu_ps(mix + i, m);
+        max = _mm_max_ps(max, m);
+    }
+
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, max);
+    peak = *std::max_element(lanes, lanes + 4);
+    return i;
+}
+
+OSMIUM_TARGET("avx2")
+uint32_t deinterleave_stereo_avx2(const float* data,
+                                  uint32_t num_frames,
+                                  float* left,
+                                  float* right,
+                                  float* mix,
+                                  float& peak) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256 max = _mm256_set1_ps(peak);
+
+    uint32_t i = 0;
+    for (; i + 8 <= num_frames; i += 8) {
+        __m256 a = _mm256_loadu_ps(data + 2 * i);
+        __m256 b = _mm256_loadu_ps(data + 2 * i + 8);
+        // Shuffling works within 128-bit lanes, which leaves the middle two pairs of
+        // samples swapped: l0 l1 l4 l5 | l2 l3 l6 l7
+        __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        l = _mm256_castpd_ps(
+            _mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0)));
+        r = _mm256_castpd_ps(
+            _mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0)));
+        __m256 m = _mm256_mul_ps(_mm256_add_ps(l, r), half);
+
+        _mm256_storeu_ps(left + i, l);
+        _mm256_storeu_ps(right + i, r);
+        _mm256_storeu_ps(mix + i, m);
+        max = _mm256_max_ps(max, m);
+    }
+
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, max);
+    peak = *std::max_element(lanes, lanes + 8);
+    return i;
+}
+
+uint32_t downmix_stereo_sse2(const float* data,
+                             uint32_t num_frames,
+                             float* mono,
+                             float& peak) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128 max = _mm_set1_ps(peak);
+
+    uint32_t i = 0;
+    for (; i + 4 <= num_frames; i += 4) {
+        __m128 a = _mm_loadu_ps(data + 2 * i);
+        __m128 b = _mm_loadu_ps(data + 2 * i + 4);
+        __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 m = _mm_mul_ps(_mm_add_ps(l, r), half);
+
+        _mm_storeu_ps(mono + i, m);
+        max = _mm_max_ps(max, m);
+    }
+
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, max);
+    peak = *std::max_element(lanes, lanes + 4);
+    return i;
+}
+
+OSMIUM_TARGET("avx2")
+uint32_t downmix_stereo_avx2(const float* data,
+                             uint32_t num_frames,
+                             float* mono,
+                             float& peak) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256 max = _mm256_set1_ps(peak);
+
+    uint32_t i = 0;
+    for (; i + 8 <= num_frames; i += 8) {
+        __m256 a = _mm256_loadu_ps(data + 2 * i);
+        __m256 b = _mm256_loadu_ps(data + 2 * i + 8);
+        // The sum comes out in the same swapped order as the shuffles (see above)
+        __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m256 m = _mm256_mul_ps(_mm256_add_ps(l, r), half);
+        m = _mm256_castpd_ps(
+            _mm256_permute4x64_pd(_mm256_castps_pd(m), _MM_SHUFFLE(3, 1, 2, 0)));
+
+        _mm256_storeu_ps(mono + i, m);
+        max = _mm256_max_ps(max, m);
+    }
+
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, max);
+    peak = *std::max_element(lanes, lanes + 8);
+    return i;
+}
+
+// The gain is applied in double precision, so each sample is converted up and back down
+
+uint32_t scale_sse2(const float* samples, double gain, uint32_t length, float* out) {
+    const __m128d g = _mm_set1_pd(gain);
+
+    uint32_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m128 x = _mm_loadu_ps(samples + i);
+        __m128 lo = _mm_cvtpd_ps(_mm_mul_pd(_mm_cvtps_pd(x), g));
+        __m128 hi = _mm_cvtpd_ps(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), g));
+        _mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+    }
+    return i;
+}
+
+OSMIUM_TARGET("avx2")
+uint32_t scale_avx2(const float* samples, double gain, uint32_t length, float* out) {
+    const __m256d g = _mm256_set1_pd(gain);
+
+    uint32_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m128 lo = _mm256_cvtpd_ps(
+            _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(samples + i)), g));
+        __m128 hi = _mm256_cvtpd_ps(
+            _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(samples + i + 4)), g));
+        _mm_storeu_ps(out + i, lo);
+        _mm_storeu_ps(out + i + 4, hi);
+    }
+    return i;
+}
+
+uint32_t average_sse2(const float* a, const float* b, uint32_t length, float* out) {
+    const __m128 half = _mm_set1_ps(0.5f);
+
+    uint32_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        _mm_storeu_ps(out + i, _mm_mul_ps(sum, half));
+    }
+    return i;
+}
+
+OSMIUM_TARGET("avx2")
+uint32_t average_avx2(const float* a, const float* b, uint32_t length, float* out) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+
+    uint32_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(sum, half));
+    }
+    return i;
+}
+
+uint32_t max_value_sse2(const float* samples, uint32_t length, float& peak) {
+    __m128 max0 = _mm_set1_ps(peak);
+    __m128 max1 = max0;
+
+    uint32_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        max0 = _mm_max_ps(max0, _mm_loadu_ps(samples + i));
+        max1 = _mm_max_ps(max1, _mm_loadu_ps(samples + i + 4));
+    }
+
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, _mm_max_ps(max0, max1));
+    peak = *std::max_element(lanes, lanes + 4);
+    return i;
+}
+
+OSMIUM_TARGET("avx2")
+uint32_t max_value_avx2(const float* samples, uint32_t length, float& peak) {
+    __m256 max0 = _mm256_set1_ps(peak);
+    __m256 max1 = max0;
+
+    uint32_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        max0 = _mm256_max_ps(max0, _mm256_loadu_ps(samples + i));
+        max1 = _mm256_max_ps(max1, _mm256_loadu_ps(samples + i + 8));
+    }
+
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, _mm256_max_ps(max0, max1));
+    peak = *std::max_element(lanes, lanes + 8);
+    return i;
+}
+
+#endif // OSMIUM_X86
+
+/** Widest kernel set worth using. The kernels here are memory-bound, so AVX-512 wouldn't
+ *  gain anything over AVX2.
+ */
+bool use_avx2() {
+    SimdLevel level = detect_simd_level();
+    return level == SimdLevel::AVX2 || level == SimdLevel::AVX512;
+}
+
+bool use_sse2() {
+    return detect_simd_level() != SimdLevel::Scalar;
+}
+
+void scale(const float* samples, double gain, uint32_t length, float* out) {
+    uint32_t i = 0;
+#ifdef OSMIUM_X86
+    if (use_avx2()) {
+        i = scale_avx2(samples, gain, length, out);
+    } else if (use_sse2()) {
+        i = scale_sse2(samples, gain, length, out);
+    }
+#endif
+
+    for (; i < length; i++) {
+        out[i] = samples[i] * gain;
+    }
+}
+
+} // namespace
+
+float deinterleave_stereo(const float* data,
+                          uint32_t num_channels,
+                          uint32_t num_frames,
+                          float* left,
+                          float* right,
+                          float* mix) {
+    float peak = LOWEST;
+
+    if (num_channels == 1) {
+        for (uint32_t i = 0; i < num_frames; i++) {
+            left[i] = data[i];
+            right[i] = 0.0f;
+            mix[i] = (left[i] + right[i]) / 2;
+            peak = std::max(peak, mix[i]);
+        }
+        return peak;
+    }
+
+    uint32_t i = 0;
+#ifdef OSMIUM_X86
+    if (num_channels == 2) {
+        if (use_avx2()) {
+            i = deinterleave_stereo_avx2(data, num_frames, left, right, mix, peak);
+        } else if (use_sse2()) {
+            i = deinterleave_stereo_sse2(data, num_frames, left, right, mix, peak);
+        }
+    }
+#endif
+
+    // TODO: Maybe try downmixing 5.1/7.1 to stereo? Probably overkill tbh.
+    for (; i < num_frames; i++) {
+        uint32_t j = i * num_channels;
+        left[i] = data[j];
+        right[i] = data[j + 1];
+        mix[i] = (left[i] + right[i]) / 2;
+        peak = std::max(peak, mix[i]);
+    }
+    return peak;
+}
+
+float downmix_to_mono(const float* data,
+                      uint32_t num_channels,
+                      uint32_t num_frames,
+                      float* mono) {
+    if (num_channels == 1) {
+        std::copy(data, data + num_frames, mono);
+        return max_value({mono, num_frames});
+    }
+
+    float peak = LOWEST;
+    uint32_t i = 0;
+#ifdef OSMIUM_X86
+    if (num_channels == 2) {
+        if (use_avx2()) {
+            i = downmix_stereo_avx2(data, num_frames, mono, peak);
+        } else if (use_sse2()) {
+            i = downmix_stereo_sse2(data, num_frames, mono, peak);
+        }
+    }
+#endif
+
+    for (; i < num_frames; i++) {
+        uint32_t j = i * num_channels;
+        mono[i] = (data[j] + data[j + 1]) * 0.5f;
+        peak = std::max(peak, mono[i]);
+    }
+    return peak;
+}
+
+void scale_stereo(const float* left,
+                  const float* right,
+                  double gain,
+                  uint32_t length,
+                  float* out_left,
+                  float* out_right,
+                  float* out_mix) {
+    scale(left, gain, length, out_left);
+    scale(right, gain, length, out_right);
+
+    uint32_t i = 0;
+#ifdef OSMIUM_X86
+    if (use_avx2()) {
+        i = average_avx2(out_left, out_right, length, out_mix);
+    } else if (use_sse2()) {
+        i = average_sse2(out_left, out_right, length, out_mix);
+    }
+#endif
+
+    for (; i < length; i++) {
+        out_mix[i] = (out_left[i] + out_right[i]) / 2;
+    }
+}
+
+void scale_mono(const float* samples, double gain, uint32_t length, float* out) {
+    scale(samples, gain, length, out);
+}
+
+float max_value(std::span<const float> samples) {
+    const float* data = samples.data();
+    auto length = static_cast<uint32_t>(samples.size());
+    float peak = LOWEST;
+
+    uint32_t i = 0;
+#ifdef OSMIUM_X86
+    if (use_avx2()) {
+        i = max_value_avx2(data, length, peak);
+    } else if (use_sse2()) {
+        i = max_value_sse2(data, length, peak);
+    }
+#endif
+
+    for (; i < length; i++) {
+        peak = std::max(peak, data[i]);
+    }
+    return peak;
+}
+
+// -- BlockPeakTracker --
+
+void BlockPeakTracker::reset(size_t history_size, size_t block_size) {
+    size_t num_blocks = block_size > 0 ? history_size / block_size : 0;
+    m_block_peaks.assign(num_blocks, 0.0f);
+    m_next_block = 0;
+    m_remainder = history_size - num_blocks * block_size;
+}
+
+void BlockPeakTracker::push_block(float peak) {
+    if (m_block_peaks.empty())
+        return;
+
+    m_block_peaks[m_next_block] = peak;
+    m_next_block = (m_next_block + 1) % m_block_peaks.size();
+}
+
+float BlockPeakTracker::peak(std::span<const float> history) const {
+    float peak = max_value(history.first(m_remainder));
+    for (float block_peak : m_block_peaks) {
+        peak = std::max(peak, block_peak);
+    }
+    return peak;
+}
+
+} // namespace osmium
@@ -0,0 +1,74 @@
+#ifndef CONDITIONING_H
+#define CONDITIONING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace osmium {
+
+// Single-pass, vectorized versions of the per-sample work a scope does on every block of
+// audio it reads. Each one produces exactly the same floats as the obvious scalar loop.
+
+/** Splits `num_frames` interleaved frames of `num_channels` channels into `left` and
+ *  `right`, and writes the average of the two to `mix`. A mono source goes to `left`,
+ *  with silence in `right`. Returns the largest value written to `mix`.
+ */
+float deinterleave_stereo(const float* data,
+                          uint32_t num_channels,
+                          uint32_t num_frames,
+                          float* left,
+                          float* right,
+                          float* mix);
+
+/** Writes the average of the first two channels of each interleaved frame (or the only
+ *  channel, for a mono source) to `mono`. Returns the largest value written.
+ */
+float downmix_to_mono(const float* data,
+                      uint32_t num_channels,
+                      uint32_t num_frames,
+                      float* mono);
+
+/** Multiplies `left` and `right` by `gain` (in double precision), and writes the average
+ *  of the results to `mix`.
+ */
+void scale_stereo(const float* left,
+                  const float* right,
+                  double gain,
+                  uint32_t length,
+                  float* out_left,
+                  float* out_right,
+                  float* out_mix);
+void scale_mono(const float* samples, double gain, uint32_t length, float* out);
+
+/** The largest of `samples`, or negative infinity if there are none. */
+float max_value(std::span<const float> samples);
+
+/** Keeps track of the largest sample in a `SampleHistory` that's always appended to in
+ *  blocks of the same size.
+ *
+ *  Rather than rescanning the whole history, it remembers the peak of each block that's
+ *  still entirely inside it. Only the part of the oldest block that hasn't been dropped
+ *  yet (less than one block) needs to be scanned again.
+ */
+class BlockPeakTracker {
+public:
+    /** Forgets everything, as if the history were full of zeros. */
+    void reset(size_t history_size, size_t block_size);
+
+    /** Records the peak of a block that was just appended to the history. */
+    void push_block(float peak);
+
+    /** The largest sample in `history`, which must be the history being tracked. */
+    float peak(std::span<const float> history) const;
+
+private:
+    std::vector<float> m_block_peaks; // Ring buffer, one entry per whole block
+    size_t m_next_block = 0;
+    size_t m_remainder = 0; // # samples at the start of the history not in a whole block
+};
+
+} // namespace osmium
+
+#endif // CONDITIONING_H
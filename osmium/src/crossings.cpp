@@ -0,0 +1,137 @@
+#include "crossings.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "similarity.h"
+#include "simd.h"
+
+namespace osmium {
+
+namespace {
+
+/** The smallest float `t` such that `f < t` iff `f < threshold` for every float `f`. */
+float float_threshold_below(double threshold) {
+    auto t = static_cast<float>(threshold);
+    if (t < threshold)
+        t = std::nextafter(t, std::numeric_limits<float>::infinity());
+    return t;
+}
+
+/** The largest float `t` such that `f > t` iff `f > threshold` for every float `f`. */
+float float_threshold_above(double threshold) {
+    auto t = static_cast<float>(threshold);
+    if (t > threshold)
+        t = std::nextafter(t, -std::numeric_limits<float>::infinity());
+    return t;
+}
+
+void compare_scalar(const float* samples,
+                    uint32_t begin,
+                    uint32_t end,
+                    float upper,
+                    float lower,
+                    float zero,
+                    float peak,
+                    ThresholdMasks& masks) {
+    for (uint32_t i = begin; i < end; i++) {
+        float f = samples[i];
+        uint64_t bit = uint64_t{1} << i;
+        masks.below_upper |= f < upper ? bit : 0;
+        masks.below_lower |= f < lower ? bit : 0;
+        masks.below_zero |= f < zero ? bit : 0;
+        masks.reached_zero |= f >= zero ? bit : 0;
+        masks.above_peak |= f > peak ? bit : 0;
+    }
+}
+
+#ifdef OSMIUM_X86
+
+uint32_t compare_sse2(const float* samples,
+                      uint32_t count,
+                      float upper,
+                      float lower,
+                      float zero,
+                      float peak,
+                      ThresholdMasks& masks) {
+    const __m128 u = _mm_set1_ps(upper);
+    const __m128 l = _mm_set1_ps(lower);
+    const __m128 z = _mm_set1_ps(zero);
+    const __m128 p = _mm_set1_ps(peak);
+
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 f = _mm_loadu_ps(samples + i);
+        masks.below_upper |= uint64_t(_mm_movemask_ps(_mm_cmplt_ps(f, u))) << i;
+        masks.below_lower |= uint64_t(_mm_movemask_ps(_mm_cmplt_ps(f, l))) << i;
+        masks.below_zero |= uint64_t(_mm_movemask_ps(_mm_cmplt_ps(f, z))) << i;
+        masks.reached_zero |= uint64_t(_mm_movemask_ps(_mm_cmpge_ps(f, z))) << i;
+        masks.above_peak |= uint64_t(_mm_movemask_ps(_mm_cmpgt_ps(f, p))) << i;
+    }
+    return i;
+}
+
+OSMIUM_TARGET("avx2")
+uint32_t compare_avx2(const float* samples,
+                      uint32_t count,
+                      float upper,
+                      float lower,
+                      float zero,
+                      float peak,
+                      ThresholdMasks& masks) {
+    const __m256 u = _mm256_set1_ps(upper);
+    const __m256 l = _mm256_set1_ps(lower);
+    const __m256 z = _mm256_set1_ps(zero);
+    const __m256 p = _mm256_set1_ps(peak);
+
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 f = _mm256_loadu_ps(samples + i);
+        // Ordered comparisons, so that NaNs compare false like they do in C++
+        int below_upper = _mm256_movemask_ps(_mm256_cmp_ps(f, u, _CMP_LT_OQ));
+        int below_lower = _mm256_movemask_ps(_mm256_cmp_ps(f, l, _CMP_LT_OQ));
+        int below_zero = _mm256_movemask_ps(_mm256_cmp_ps(f, z, _CMP_LT_OQ));
+        int reached_zero = _mm256_movemask_ps(_mm256_cmp_ps(f, z, _CMP_GE_OQ));
+        int above_peak = _mm256_movemask_ps(_mm256_cmp_ps(f, p, _CMP_GT_OQ));
+
+        masks.below_upper |= uint64_t(below_upper) << i;
+        masks.below_lower |= uint64_t(below_lower) << i;
+        masks.below_zero |= uint64_t(below_zero) << i;
+        masks.reached_zero |= uint64_t(reached_zero) << i;
+        masks.above_peak |= uint64_t(above_peak) << i;
+    }
+    return i;
+}
+
+#endif // OSMIUM_X86
+
+} // namespace
+
+ThresholdComparator::ThresholdComparator(double upper,
+                                         double lower,
+                                         double zero,
+                                         double peak)
+    : m_upper(float_threshold_below(upper)),
+      m_lower(float_threshold_below(lower)),
+      m_zero(float_threshold_below(zero)),
+      m_peak(float_threshold_above(peak)) {}
+
+ThresholdMasks ThresholdComparator::compare(const float* samples, uint32_t count) const {
+    ThresholdMasks masks{};
+    uint32_t i = 0;
+
+#ifdef OSMIUM_X86
+    SimdLevel level = detect_simd_level();
+    if (level == SimdLevel::AVX2 || level == SimdLevel::AVX512) {
+        i = compare_avx2(samples, count, m_upper, m_lower, m_zero, m_peak, masks);
+    } else if (level == SimdLevel::SSE2) {
+        i = compare_sse2(samples, count, m_upper, m_lower, m_zero, m_peak, masks);
+    }
+#endif
+
+    compare_scalar(samples, i, count, m_upper, m_lower, m_zero, m_peak, masks);
+    return masks;
+}
+
+} // namespace osmium
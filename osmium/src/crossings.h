@@ -0,0 +1,41 @@
+#ifndef CROSSINGS_H
+#define CROSSINGS_H
+
+#include <cstdint>
+
+namespace osmium {
+
+/** Results of comparing up to 64 consecutive samples against a set of thresholds. Bit i
+ *  of each mask is for sample i; bits past the last sample are 0.
+ */
+struct ThresholdMasks {
+    uint64_t below_upper;  // sample < upper
+    uint64_t below_lower;  // sample < lower
+    uint64_t below_zero;   // sample < zero
+    uint64_t reached_zero; // sample >= zero
+    uint64_t above_peak;   // sample > peak
+};
+
+/** Compares blocks of samples against fixed thresholds, a whole SIMD vector at a time.
+ *
+ *  The thresholds are given as doubles, but rounded to floats in whichever direction
+ *  makes every comparison against a float sample come out exactly as it would against
+ *  the original double. (NaNs compare false, as usual.)
+ */
+class ThresholdComparator {
+public:
+    ThresholdComparator(double upper, double lower, double zero, double peak);
+
+    /** Compares `count` samples, where `count` is at most 64. */
+    ThresholdMasks compare(const float* samples, uint32_t count) const;
+
+private:
+    float m_upper;
+    float m_lower;
+    float m_zero;
+    float m_peak;
+};
+
+} // namespace osmium
+
+#endif // CROSSINGS_H
@@ -0,0 +1,99 @@
+#include "decimator.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <numeric>
+#include <vector>
+
+namespace osmium {
+
+namespace {
+
+// Taps on each side of the center, per unit of decimation. More taps make a sharper
+// cutoff (less aliasing, flatter passband) at the cost of more work per frame.
+constexpr uint32_t TAPS_PER_FACTOR = 8;
+// Where the passband ends, as a fraction of the output Nyquist frequency. Leaves some
+// room for the transition band below Nyquist.
+constexpr double CUTOFF = 0.9;
+
+/** A Blackman-windowed sinc low-pass with the given cutoff (in cycles per sample),
+ *  normalized to unity gain at DC.
+ */
+std::vector<float> lowpass_taps(uint32_t reach, double cutoff) {
+    std::vector<double> taps(2 * reach + 1);
+    for (size_t i = 0; i < taps.size(); i++) {
+        double k = static_cast<double>(i) - reach;
+        double sinc = k == 0.0 ? 2.0 * cutoff
+                               : std::sin(2.0 * std::numbers::pi * cutoff * k)
+                                     / (std::numbers::pi * k);
+        double x = std::numbers::pi * k / (reach + 1);
+        double window = 0.42 + 0.5 * std::cos(x) + 0.08 * std::cos(2.0 * x);
+        taps[i] = sinc * window;
+    }
+
+    double sum = std::accumulate(taps.begin(), taps.end(), 0.0);
+    std::vector<float> normalized(taps.size());
+    for (size_t i = 0; i < taps.size(); i++) {
+        normalized[i] = static_cast<float>(taps[i] / sum);
+    }
+    return normalized;
+}
+
+} // namespace
+
+Decimator::Decimator(uint32_t factor, uint32_t num_channels)
+    : m_factor(factor),
+      m_num_channels(num_channels),
+      m_reach(TAPS_PER_FACTOR * factor),
+      m_taps(lowpass_taps(m_reach, CUTOFF * 0.5 / factor)) {}
+
+uint64_t Decimator::input_frames_for(uint32_t num_out) const {
+    if (num_out == 0)
+        return 0;
+    return static_cast<uint64_t>(num_out - 1) * m_factor + 2 * m_reach + 1;
+}
+
+void Decimator::process(const float* in, uint32_t num_out, float* out) const {
+    const size_t stride = m_num_channels;
+    for (uint32_t i = 0; i < num_out; i++) {
+        const float* window = in + static_cast<size_t>(i) * m_factor * stride;
+        for (uint32_t c = 0; c < m_num_channels; c++) {
+            float sum = 0.0f;
+            for (size_t t = 0; t < m_taps.size(); t++) {
+                sum += m_taps[t] * window[t * stride + c];
+            }
+            out[static_cast<size_t>(i) * stride + c] = sum;
+        }
+    }
+}
+
+uint32_t decimation_factor(uint32_t sample_rate,
+                           uint32_t frame_rate,
+                           uint32_t analysis_rate) {
+    if (analysis_rate == 0 || frame_rate == 0 || analysis_rate >= sample_rate)
+        return 1;
+
+    uint32_t common = std::gcd(sample_rate, sample_rate / frame_rate);
+    double target = static_cast<double>(sample_rate) / analysis_rate;
+
+    uint32_t best = 1;
+    double best_distance = std::abs(std::log(target));
+    for (uint32_t factor = 2; factor <= common; factor++) {
+        if (common % factor != 0)
+            continue;
+
+        double distance = std::abs(std::log(factor / target));
+        if (distance < best_distance) {
+            best = factor;
+            best_distance = distance;
+        }
+        // Every factor from here on is further off than this one
+        if (factor > target)
+            break;
+    }
+    return best;
+}
+
+} // namespace osmium
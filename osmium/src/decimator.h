@@ -0,0 +1,54 @@
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <cstdint>
+#include <vector>
+
+namespace osmium {
+
+/** Low-pass filters interleaved audio and keeps every `factor`-th frame, so it can be
+ *  analyzed at a fraction of its original sample rate without aliasing.
+ *
+ *  The filter is a linear-phase FIR centered on each frame it keeps, so output frame `m`
+ *  lines up exactly with input frame `m * factor`. Computing it takes `get_reach()`
+ *  frames of context on either side.
+ */
+class Decimator {
+public:
+    Decimator(uint32_t factor, uint32_t num_channels);
+
+    uint32_t get_factor() const { return m_factor; }
+    /** Input frames the filter looks at on each side of the frame it's centered on. */
+    uint32_t get_reach() const { return m_reach; }
+
+    /** Input frames `process()` needs to produce `num_out` output frames. */
+    uint64_t input_frames_for(uint32_t num_out) const;
+
+    /** Writes `num_out` frames to `out`. `in` holds the input, starting `get_reach()`
+     *  frames before the frame under the first output frame.
+     */
+    void process(const float* in, uint32_t num_out, float* out) const;
+
+private:
+    uint32_t m_factor;
+    uint32_t m_num_channels;
+    uint32_t m_reach;
+    std::vector<float> m_taps;
+};
+
+/** The factor to decimate audio at `sample_rate` by, to analyze it at (about)
+ *  `analysis_rate` while rendering at `frame_rate`.
+ *
+ *  The factor has to divide both the sample rate and the samples per frame, or decimated
+ *  frames would drift away from the audio track's. Of the factors that do, this picks the
+ *  one whose rate is nearest `analysis_rate` (by ratio), which may be above or below it.
+ *  Returns 1 if no decimation should (or can) happen, e.g. at 44.1 kHz and 24 fps, where
+ *  nothing but 1 divides both.
+ */
+uint32_t decimation_factor(uint32_t sample_rate,
+                           uint32_t frame_rate,
+                           uint32_t analysis_rate);
+
+} // namespace osmium
+
+#endif // DECIMATOR_H
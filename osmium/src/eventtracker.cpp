@@ -1,83 +1,53 @@
 #include "eventtracker.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
 #include <vector>
 
-#include <bass.h>
-#include <bassmidi.h>
-
 #include "error.h"
 #include "handlewrapper.h"
 
 namespace osmium {
 
-EventTracker::EventTracker(uint32_t raw_handle, uint32_t fps) : m_s_per_frame(1.0 / fps) {
-    if (!raw_handle)
+namespace {
+
+uint32_t check_handle(uint32_t handle) {
+    if (!handle)
         throw Error::from_bass_error("Error creating EventTracker: ");
+    return handle;
+}
 
-    HandleWrapper handle(raw_handle);
-
-    uint32_t num_events = BASS_MIDI_StreamGetEvents(*handle, -1, 0, nullptr);
-    if (num_events == -1)
-        throw Error::from_bass_error();
-    m_events.resize(num_events);
-    m_times.reserve(num_events);
-
-    // Make sure that osmium::Event can be reinterpret_cast'ed to BASS_MIDI_EVENT safely
-    // Can't use std::is_layout_compatible because DWORDs are either unsigned long or
-    // uint32_t (unsigned int) depending on OS
-    static_assert(sizeof(Event) == sizeof(BASS_MIDI_EVENT)
-                  && alignof(Event) == alignof(BASS_MIDI_EVENT));
-
-    uint32_t result = BASS_MIDI_StreamGetEvents(
-        *handle, -1, 0, reinterpret_cast<BASS_MIDI_EVENT*>(m_events.data()));
-    if (result == -1)
-        throw Error::from_bass_error();
-
-    // Calculate timestamps for each event
-    float ticks_per_qn_f;
-    if (!BASS_ChannelGetAttribute(*handle, BASS_ATTRIB_MIDI_PPQN, &ticks_per_qn_f))
-        throw Error::from_bass_error("Could not get PPQN attribute: ");
-    double qn_per_tick = 1.0 / ticks_per_qn_f;
-
-    // seconds per tick = us/qn * qn/tick * 1000000
-    // default tempo is 120bpm = 500000 us/qn
-    double s_per_tick = 0.5 * qn_per_tick;
-    double time_of_last_tempo_change = 0;
-    uint32_t tick_of_last_tempo_change = 0;
-    double cur_seconds = 0;
-    for (const auto& event : m_events) {
-        cur_seconds = time_of_last_tempo_change
-                      + (event.tick - tick_of_last_tempo_change) * s_per_tick;
-
-        if (event.event == Event::Tempo) {
-            s_per_tick = event.param * qn_per_tick * 1e-6;
-            time_of_last_tempo_change = cur_seconds;
-            tick_of_last_tempo_change = event.tick;
-        }
+} // namespace
 
-        m_times.push_back(cur_seconds);
-    }
-}
+EventTracker::EventTracker(uint32_t raw_handle, uint32_t fps)
+    : EventTracker(std::make_shared<const MidiDocument>(
+                       *HandleWrapper(check_handle(raw_handle))),
+                   fps) {}
 
 EventTracker::EventTracker(const char* filename, uint32_t fps)
-    : EventTracker(
-          BASS_MIDI_StreamCreateFile(false, filename, 0, 0, BASS_STREAM_DECODE, 0), fps) {
-}
+    : EventTracker(std::make_shared<const MidiDocument>(filename), fps) {}
+
+EventTracker::EventTracker(std::shared_ptr<const MidiDocument> document, uint32_t fps)
+    : m_document(std::move(document)), m_s_per_frame(1.0 / fps) {}
 
 void EventTracker::next_events() {
+    const auto& events = m_document->get_events();
+    const auto& times = m_document->get_event_times();
     m_event_window.clear();
 
-    if (m_event_index >= m_events.size())
+    if (m_event_index >= events.size())
         return;
 
     m_cur_frame++;
     double seconds = m_cur_frame * m_s_per_frame;
 
     size_t i;
-    for (i = m_event_index; i < m_times.size(); i++) {
-        if (m_times[i] < seconds) {
-            m_event_window.emplace_back(m_events[i]);
+    for (i = m_event_index; i < times.size(); i++) {
+        if (times[i] < seconds) {
+            m_event_window.emplace_back(events[i]);
         } else {
             break;
         }
@@ -85,4 +55,36 @@ void EventTracker::next_events() {
     m_event_index = i;
 }
 
+void EventTracker::seek(uint64_t frame) {
+    const auto& events = m_document->get_events();
+    const auto& times = m_document->get_event_times();
+    m_cur_frame = frame;
+
+    // Events at exactly the start of a frame belong to that frame
+    double seconds = m_cur_frame * m_s_per_frame;
+    auto it = std::ranges::lower_bound(times, seconds);
+    m_event_index = it - times.begin();
+
+    // Gather the latest program and bank of every channel
+    std::map<std::pair<uint32_t, Event::EventType>, size_t> latest;
+    for (size_t i = 0; i < m_event_index; i++) {
+        const auto& event = events[i];
+        if (event.event == Event::Program || event.event == Event::Bank) {
+            latest[{event.chan, event.event}] = i;
+        }
+    }
+
+    // In their original order, so e.g. a bank change still comes before its program
+    std::vector<size_t> indices;
+    for (const auto& [key, index] : latest) {
+        indices.push_back(index);
+    }
+    std::ranges::sort(indices);
+
+    m_event_window.clear();
+    for (size_t index : indices) {
+        m_event_window.emplace_back(events[index]);
+    }
+}
+
 } // namespace osmium
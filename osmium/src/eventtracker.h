@@ -2,44 +2,40 @@
 #define EVENTTRACKER_H
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
-namespace osmium {
+#include "mididocument.h"
 
-// Should be compatible with BASS_MIDI_EVENT from bassmidi.h.
-// (Annoyingly, BASS uses DWORDs, which are typedef'd to unsigned long on Windows but
-// unsigned int (via uint32_t) on other OSes. This makes conversion annoying.)
-struct Event {
-    // Warning: extremely incomplete!
-    enum EventType : uint32_t {
-        Note = 1,
-        Program = 2,
-        Bank = 10,
-        Tempo = 62,
-    };
-
-    EventType event;
-    uint32_t param;
-    uint32_t chan;
-    uint32_t tick;
-    uint32_t pos;
-};
+namespace osmium {
 
 class EventTracker {
 public:
     EventTracker(uint32_t raw_handle, uint32_t fps);
     EventTracker(const char* filename, uint32_t fps);
+    EventTracker(std::shared_ptr<const MidiDocument> document, uint32_t fps);
 
     void next_events();
     const std::vector<Event>& get_events() const { return m_event_window; }
 
+    /** Jumps to `frame`, so that the next `next_events()` returns that frame's events.
+     *  Until then, `get_events()` returns the last Program and Bank events of each
+     *  channel before the new position, so anything tracking them can catch up.
+     */
+    void seek(uint64_t frame);
+
+    // Every event in the file, and the time of each one in seconds
+    const std::vector<Event>& get_all_events() const { return m_document->get_events(); }
+    const std::vector<double>& get_event_times() const {
+        return m_document->get_event_times();
+    }
+
 private:
+    std::shared_ptr<const MidiDocument> m_document;
     std::vector<Event> m_event_window;
-    std::vector<Event> m_events;
-    std::vector<double> m_times;
 
     size_t m_event_index = 0;
-    unsigned int m_cur_frame = 0;
+    uint64_t m_cur_frame = 0;
     double m_s_per_frame;
 };
 
@@ -0,0 +1,79 @@
+#include "fft.h"
+
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <numbers>
+#include <utility>
+
+#include "error.h"
+
+namespace osmium {
+
+FftPlan::FftPlan(size_t size) : m_size(size) {
+    if (!std::has_single_bit(size))
+        throw Error("FFT size must be a power of two");
+
+    int bits = std::countr_zero(size);
+    m_bit_reverse.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        size_t reversed = 0;
+        for (int b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        m_bit_reverse[i] = reversed;
+    }
+
+    m_twiddles.resize(size / 2);
+    for (size_t k = 0; k < size / 2; k++) {
+        double angle = -2.0 * std::numbers::pi * static_cast<double>(k) / size;
+        m_twiddles[k] = std::polar(1.0, angle);
+    }
+}
+
+void FftPlan::forward(std::complex<double>* data) const {
+    transform(data, false);
+}
+
+void FftPlan::inverse(std::complex<double>* data) const {
+    transform(data, true);
+
+    double scale = 1.0 / m_size;
+    for (size_t i = 0; i < m_size; i++) {
+        data[i] *= scale;
+    }
+}
+
+void FftPlan::transform(std::complex<double>* data, bool inverse) const {
+    for (size_t i = 0; i < m_size; i++) {
+        size_t j = m_bit_reverse[i];
+        if (i < j)
+            std::swap(data[i], data[j]);
+    }
+
+    // Iterative Cooley-Tukey. At each stage, the twiddle table is strided so that it
+    // holds the roots of unity for the current butterfly length.
+    for (size_t len = 2; len <= m_size; len *= 2) {
+        size_t half = len / 2;
+        size_t stride = m_size / len;
+        for (size_t start = 0; start < m_size; start += len) {
+            for (size_t k = 0; k < half; k++) {
+                std::complex<double> w = m_twiddles[k * stride];
+                if (inverse)
+                    w = std::conj(w);
+
+                // Multiply out by hand; operator* on std::complex has to handle
+                // infinities and NaNs, which makes it far slower than it needs to be.
+                std::complex<double> x = data[start + k + half];
+                std::complex<double> odd{x.real() * w.real() - x.imag() * w.imag(),
+                                         x.real() * w.imag() + x.imag() * w.real()};
+                std::complex<double> even = data[start + k];
+                data[start + k] = even + odd;
+                data[start + k + half] = even - odd;
+            }
+        }
+    }
+}
+
+} // namespace osmium
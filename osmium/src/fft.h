@@ -0,0 +1,34 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace osmium {
+
+/** Precomputed tables for an in-place radix-2 FFT of a fixed, power-of-two size. Plans
+ *  are immutable once built, so a single plan can be reused for every transform of that
+ *  size.
+ */
+class FftPlan {
+public:
+    explicit FftPlan(size_t size);
+
+    size_t size() const { return m_size; }
+
+    void forward(std::complex<double>* data) const;
+    /** The inverse transform, including the 1/N normalization. */
+    void inverse(std::complex<double>* data) const;
+
+private:
+    size_t m_size;
+    std::vector<size_t> m_bit_reverse;
+    std::vector<std::complex<double>> m_twiddles;
+
+    void transform(std::complex<double>* data, bool inverse) const;
+};
+
+} // namespace osmium
+
+#endif // FFT_H
@@ -12,16 +12,16 @@ HandleWrapper::HandleWrapper(uint32_t handle) : m_handle(handle), m_extra_data(n
 HandleWrapper::HandleWrapper(HandleWrapper&& other) noexcept : m_handle(other.m_handle) {
     other.m_handle = 0;
     m_extra_data.swap(other.m_extra_data);
-    m_soundfont_handles = std::move(other.m_soundfont_handles);
-    other.m_soundfont_handles.clear();
+    m_soundfonts = std::move(other.m_soundfonts);
+    other.m_soundfonts.clear();
 }
 
 HandleWrapper& HandleWrapper::operator=(HandleWrapper&& other) noexcept {
     m_handle = other.m_handle;
     other.m_handle = 0;
     m_extra_data.swap(other.m_extra_data);
-    m_soundfont_handles = std::move(other.m_soundfont_handles);
-    other.m_soundfont_handles.clear();
+    m_soundfonts = std::move(other.m_soundfonts);
+    other.m_soundfonts.clear();
     return *this;
 }
 
@@ -31,9 +31,7 @@ HandleWrapper::~HandleWrapper() {
         m_handle = 0;
     }
 
-    for (HSOUNDFONT hsf : m_soundfont_handles) {
-        BASS_MIDI_FontFree(hsf);
-    }
+    // The soundfonts themselves are freed once nothing else holds a reference to them
 }
 
 uint32_t HandleWrapper::operator*() const {
@@ -48,17 +46,25 @@ const std::unique_ptr<int>& HandleWrapper::extra_data_ptr() {
     return m_extra_data;
 }
 
-void HandleWrapper::set_soundfonts(const std::vector<HSOUNDFONT>& soundfonts) {
-    m_soundfont_handles = soundfonts;
+void HandleWrapper::set_soundfonts(
+    const std::vector<std::shared_ptr<SoundFont>>& soundfonts) {
+    m_soundfonts = soundfonts;
 
     std::vector<BASS_MIDI_FONT> font_structs;
     font_structs.reserve(soundfonts.size());
-    for (auto hsf : soundfonts) {
-        font_structs.emplace_back(BASS_MIDI_FONT{hsf, -1, 0});
+    for (const auto& sf : soundfonts) {
+        font_structs.emplace_back(BASS_MIDI_FONT{**sf, -1, 0});
     }
 
     if (!BASS_MIDI_StreamSetFonts(m_handle, font_structs.data(), font_structs.size()))
         throw Error::from_bass_error("Error applying soundfonts: ");
 }
 
+void HandleWrapper::set_quality(const SynthQuality& quality) {
+    if (quality.max_voices > 0
+        && !BASS_ChannelSetAttribute(
+            m_handle, BASS_ATTRIB_MIDI_VOICES, static_cast<float>(quality.max_voices)))
+        throw Error::from_bass_error("Error setting voice limit: ");
+}
+
 } // namespace osmium
@@ -5,6 +5,8 @@
 #include <memory>
 #include <vector>
 
+#include "soundfont.h"
+
 namespace osmium {
 
 class HandleWrapper {
@@ -21,12 +23,13 @@ public:
 
     void set_extra_data(int n);
     const std::unique_ptr<int>& extra_data_ptr();
-    void set_soundfonts(const std::vector<unsigned long>&);
+    void set_soundfonts(const std::vector<std::shared_ptr<SoundFont>>&);
+    void set_quality(const SynthQuality&);
 
 private:
     uint32_t m_handle;
     std::unique_ptr<int> m_extra_data;
-    std::vector<unsigned long> m_soundfont_handles;
+    std::vector<std::shared_ptr<SoundFont>> m_soundfonts;
 };
 
 } // namespace osmium
@@ -0,0 +1,23 @@
+#include "hashing.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "error.h"
+
+namespace osmium {
+
+void hash_file_contents(Hasher& hasher, const std::string& filename) {
+    std::ifstream is(filename, std::ios::binary);
+    if (!is)
+        throw Error("Could not open " + filename);
+
+    std::vector<char> chunk(64 * 1024);
+    while (is) {
+        is.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        hasher.update(chunk.data(), static_cast<size_t>(is.gcount()));
+    }
+}
+
+} // namespace osmium
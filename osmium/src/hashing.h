@@ -0,0 +1,42 @@
+#ifndef HASHING_H
+#define HASHING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace osmium {
+
+/** 64-bit FNV-1a. Not cryptographic, but plenty for telling cache entries apart. */
+class Hasher {
+public:
+    void update(const void* data, size_t size) {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            m_hash ^= bytes[i];
+            m_hash *= 0x100000001b3ULL;
+        }
+    }
+
+    template<typename T>
+    void update(const T& value) {
+        update(&value, sizeof(value));
+    }
+
+    void update(const std::string& str) {
+        update(str.data(), str.size());
+        update(str.size());
+    }
+
+    uint64_t digest() const { return m_hash; }
+
+private:
+    uint64_t m_hash = 0xcbf29ce484222325ULL;
+};
+
+/** Feeds the entire contents of a file to `hasher`. */
+void hash_file_contents(Hasher& hasher, const std::string& filename);
+
+} // namespace osmium
+
+#endif // HASHING_H
@@ -0,0 +1,137 @@
+#include "mappedfile.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "error.h"
+
+namespace osmium {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    HANDLE file = CreateFileW(path.c_str(),
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw Error("Could not open " + path.string());
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw Error("Could not get the size of " + path.string());
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+
+    // Empty files can't be mapped; leave m_data null
+    if (m_size > 0) {
+        m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping) {
+            m_data = static_cast<const std::byte*>(
+                MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+    }
+
+    // The mapping keeps the file open on its own
+    CloseHandle(file);
+
+    if (m_size > 0 && !m_data) {
+        unmap();
+        throw Error("Could not memory-map " + path.string());
+    }
+}
+
+void MappedFile::unmap() {
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_size = 0;
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw Error("Could not open " + path.string());
+
+    struct stat st {};
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw Error("Could not get the size of " + path.string());
+    }
+    m_size = static_cast<size_t>(st.st_size);
+
+    // Empty files can't be mapped; leave m_data null
+    if (m_size > 0) {
+        void* addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED)
+            m_data = static_cast<const std::byte*>(addr);
+    }
+
+    // The mapping keeps the file open on its own
+    close(fd);
+
+    if (m_size > 0 && !m_data) {
+        m_size = 0;
+        throw Error("Could not memory-map " + path.string());
+    }
+}
+
+void MappedFile::unmap() {
+    if (m_data)
+        munmap(const_cast<std::byte*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)) {
+#ifdef _WIN32
+    m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+        m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+} // namespace osmium
@@ -0,0 +1,127 @@
+#include "mididocument.h"
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <bass.h>
+#include <bassmidi.h>
+
+#include "error.h"
+#include "handlewrapper.h"
+
+namespace osmium {
+
+namespace {
+
+HandleWrapper open_midi_file(const char* filename) {
+    HandleWrapper handle(
+        BASS_MIDI_StreamCreateFile(false, filename, 0, 0, BASS_STREAM_DECODE, 0));
+    if (!*handle)
+        throw Error::from_bass_error("Error opening MIDI file: ");
+    return handle;
+}
+
+struct ChannelPreset {
+    int bank = 0;
+    int program = 0;
+    bool drums = false;
+};
+
+} // namespace
+
+MidiDocument::MidiDocument(uint32_t handle) {
+    uint32_t num_events = BASS_MIDI_StreamGetEvents(handle, -1, 0, nullptr);
+    if (num_events == -1)
+        throw Error::from_bass_error();
+    m_events.resize(num_events);
+    m_times.reserve(num_events);
+
+    // Make sure that osmium::Event can be reinterpret_cast'ed to BASS_MIDI_EVENT safely
+    // Can't use std::is_layout_compatible because DWORDs are either unsigned long or
+    // uint32_t (unsigned int) depending on OS
+    static_assert(sizeof(Event) == sizeof(BASS_MIDI_EVENT)
+                  && alignof(Event) == alignof(BASS_MIDI_EVENT));
+
+    uint32_t result = BASS_MIDI_StreamGetEvents(
+        handle, -1, 0, reinterpret_cast<BASS_MIDI_EVENT*>(m_events.data()));
+    if (result == -1)
+        throw Error::from_bass_error();
+
+    // Calculate timestamps for each event
+    float ticks_per_qn_f;
+    if (!BASS_ChannelGetAttribute(handle, BASS_ATTRIB_MIDI_PPQN, &ticks_per_qn_f))
+        throw Error::from_bass_error("Could not get PPQN attribute: ");
+    double qn_per_tick = 1.0 / ticks_per_qn_f;
+
+    // seconds per tick = us/qn * qn/tick * 1000000
+    // default tempo is 120bpm = 500000 us/qn
+    double s_per_tick = 0.5 * qn_per_tick;
+    double time_of_last_tempo_change = 0;
+    uint32_t tick_of_last_tempo_change = 0;
+    double cur_seconds = 0;
+    for (const auto& event : m_events) {
+        cur_seconds = time_of_last_tempo_change
+                      + (event.tick - tick_of_last_tempo_change) * s_per_tick;
+
+        if (event.event == Event::Tempo) {
+            s_per_tick = event.param * qn_per_tick * 1e-6;
+            time_of_last_tempo_change = cur_seconds;
+            tick_of_last_tempo_change = event.tick;
+        }
+
+        m_times.push_back(cur_seconds);
+    }
+}
+
+// The stream only has to live until the events are read
+MidiDocument::MidiDocument(const char* filename)
+    : MidiDocument(*open_midi_file(filename)) {}
+
+std::vector<Preset> MidiDocument::get_used_presets() const {
+    std::map<uint32_t, ChannelPreset> channels;
+    std::set<Preset> used;
+
+    for (const auto& event : m_events) {
+        auto [it, inserted] = channels.try_emplace(event.chan);
+        ChannelPreset& channel = it->second;
+        if (inserted) {
+            channel.drums = is_gm_drum_channel(event.chan);
+        }
+
+        switch (event.event) {
+        case Event::Program:
+            channel.program = static_cast<int>(event.param);
+            break;
+        case Event::Bank:
+            channel.bank = static_cast<int>(event.param);
+            break;
+        case Event::Drums:
+            channel.drums = event.param != 0;
+            break;
+        case Event::Note:
+            // Velocity in the high byte; a velocity of 0 is a release
+            if (((event.param >> 8) & 0xFF) > 0) {
+                int bank = channel.drums ? Preset::DRUM_BANK : channel.bank;
+                used.insert(Preset{.bank = bank, .program = channel.program});
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return {used.begin(), used.end()};
+}
+
+std::vector<uint32_t> MidiDocument::get_used_channels() const {
+    std::set<uint32_t> used;
+    for (const auto& event : m_events) {
+        if (event.event == Event::Note && ((event.param >> 8) & 0xFF) > 0)
+            used.insert(event.chan);
+    }
+    return {used.begin(), used.end()};
+}
+
+} // namespace osmium
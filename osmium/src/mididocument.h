@@ -0,0 +1,75 @@
+#ifndef MIDIDOCUMENT_H
+#define MIDIDOCUMENT_H
+
+#include <cstdint>
+#include <vector>
+
+#include "soundfont.h"
+
+namespace osmium {
+
+// General MIDI reserves channel 10 for percussion
+constexpr uint32_t GM_DRUM_CHANNEL = 9;
+
+// Files with more than one port have more than 16 channels; each port has its own drums
+constexpr bool is_gm_drum_channel(uint32_t channel) {
+    return channel % 16 == GM_DRUM_CHANNEL;
+}
+
+// Should be compatible with BASS_MIDI_EVENT from bassmidi.h.
+// (Annoyingly, BASS uses DWORDs, which are typedef'd to unsigned long on Windows but
+// unsigned int (via uint32_t) on other OSes. This makes conversion annoying.)
+struct Event {
+    // Warning: extremely incomplete!
+    enum EventType : uint32_t {
+        Note = 1,
+        Program = 2,
+        PitchBend = 4,
+        PitchRange = 5,
+        Drums = 6,
+        FineTune = 7,
+        CoarseTune = 8,
+        Bank = 10,
+        Sustain = 15,
+        SoundOff = 16,
+        NotesOff = 18,
+        Tempo = 62,
+    };
+
+    EventType event;
+    uint32_t param;
+    uint32_t chan;
+    uint32_t tick;
+    uint32_t pos;
+};
+
+/** Every event of a MIDI file and the time of each one, read once and shared by
+ *  everything that follows the song (event trackers, note trackers, ...). Get one from
+ *  `MidiSynth::get_document()` to reuse the file the synth already parsed.
+ */
+class MidiDocument {
+public:
+    /** Reads the events of an open MIDI stream, which stays open. */
+    explicit MidiDocument(uint32_t handle);
+    explicit MidiDocument(const char* filename);
+
+    const std::vector<Event>& get_events() const { return m_events; }
+    // In seconds
+    const std::vector<double>& get_event_times() const { return m_times; }
+
+    /** Every preset a note is played with, going by the program, bank and drum changes
+     *  before it. Presets that are selected but never played aren't included.
+     */
+    std::vector<Preset> get_used_presets() const;
+
+    /** Every channel a note is played on, in ascending order. */
+    std::vector<uint32_t> get_used_channels() const;
+
+private:
+    std::vector<Event> m_events;
+    std::vector<double> m_times;
+};
+
+} // namespace osmium
+
+#endif // MIDIDOCUMENT_H
@@ -0,0 +1,390 @@
+#include "midisynth.h"
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <bass.h>
+#include <bassmidi.h>
+
+#include "error.h"
+#include "soundfont.h"
+
+namespace osmium {
+
+namespace {
+
+constexpr uint32_t SYNTH_FLAGS =
+    BASS_SAMPLE_FLOAT | BASS_STREAM_DECODE | BASS_MIDI_DECAYEND;
+// Frames to synthesize at a time when a reader skips ahead
+constexpr uint32_t SKIP_BLOCK_FRAMES = 4096;
+
+} // namespace
+
+MidiSynth::MidiSynth(const char* filename,
+                     const std::vector<std::string>& soundfonts,
+                     bool mmap_soundfonts,
+                     uint32_t sample_rate,
+                     const SynthQuality& quality)
+    : m_stream_handle(
+          BASS_MIDI_StreamCreateFile(false, filename, 0, 0, SYNTH_FLAGS, sample_rate)),
+      m_filename(filename),
+      m_soundfont_filenames(soundfonts),
+      m_quality(quality) {
+    if (!*m_stream_handle)
+        throw Error::from_bass_error("Error creating stream: ");
+
+    BASS_CHANNELINFO info;
+    if (!BASS_ChannelGetInfo(*m_stream_handle, &info))
+        throw Error::from_bass_error("Error getting channel info: ");
+
+    m_sample_rate = info.freq;
+    m_num_channels = info.chans;
+
+    if (!soundfonts.empty()) {
+        m_soundfonts = load_soundfonts(soundfonts, mmap_soundfonts);
+        m_stream_handle.set_soundfonts(m_soundfonts);
+    }
+    m_stream_handle.set_quality(quality);
+}
+
+uint64_t MidiSynth::get_total_samples() const {
+    QWORD num_bytes = BASS_ChannelGetLength(*m_stream_handle, BASS_POS_BYTE);
+    if (num_bytes == static_cast<QWORD>(-1))
+        return std::numeric_limits<uint64_t>::max();
+    return num_bytes / sizeof(float);
+}
+
+uint64_t MidiSynth::get_source_key() const {
+    return StemCache::source_key(
+        m_filename, m_soundfont_filenames, m_sample_rate, SYNTH_FLAGS, m_quality);
+}
+
+std::shared_ptr<const MidiDocument> MidiSynth::get_document() {
+    std::scoped_lock lock(m_mutex);
+    if (!m_document)
+        m_document = std::make_shared<const MidiDocument>(*m_stream_handle);
+    return m_document;
+}
+
+PreloadReport MidiSynth::preload_soundfonts() {
+    {
+        std::scoped_lock lock(m_mutex);
+        bool all_cached =
+            m_stem_cache && !m_channels.empty()
+            && std::ranges::all_of(m_channels, [this](const auto& item) {
+                   return !needs_stem(item.first) || m_stem_cache->has_stem(item.first);
+               });
+        if (all_cached)
+            return {};
+    }
+
+    return preload_presets(m_soundfonts, get_document()->get_used_presets());
+}
+
+void MidiSynth::enable_stem_cache(const std::filesystem::path& cache_dir) {
+    std::scoped_lock lock(m_mutex);
+    if (m_started)
+        throw Error("Cannot enable the stem cache after synthesis has started");
+
+    m_stem_cache.emplace(cache_dir,
+                         m_filename,
+                         m_soundfont_filenames,
+                         m_sample_rate,
+                         SYNTH_FLAGS,
+                         m_quality);
+
+    if (!m_document)
+        m_document = std::make_shared<const MidiDocument>(*m_stream_handle);
+    for (uint32_t channel : m_document->get_used_channels()) {
+        m_used_channels.insert(static_cast<int>(channel));
+    }
+}
+
+int MidiSynth::add_reader(int channel) {
+    std::scoped_lock lock(m_mutex);
+    if (m_started)
+        throw Error("Cannot add a reader after synthesis has started");
+
+    if (channel == MASTER_MIX) {
+        // Copied from the mix as it's decoded, so there's no channel stream to read
+        m_channels.try_emplace(channel, ChannelBuffer{.handle = 0});
+    } else if (!m_channels.contains(channel)) {
+        // Channel streams receive their data whenever the parent MIDI stream is decoded
+        // (and no longer show up in its output), and are freed along with it.
+        DWORD bass_channel = channel;
+        if (channel == CHORUS_BUS) {
+            bass_channel = BASS_MIDI_CHAN_CHORUS;
+        } else if (channel == REVERB_BUS) {
+            bass_channel = BASS_MIDI_CHAN_REVERB;
+        }
+
+        HSTREAM handle = BASS_MIDI_StreamGetChannel(*m_stream_handle, bass_channel);
+        if (!handle)
+            throw Error::from_bass_error("Error getting channel stream: ");
+        m_channels.emplace(channel,
+                           ChannelBuffer{.handle = static_cast<uint32_t>(handle)});
+    }
+
+    m_readers.emplace_back(Reader{.channel = channel});
+    return static_cast<int>(m_readers.size()) - 1;
+}
+
+uint32_t MidiSynth::read(int reader_id, float* out, uint32_t num_frames) {
+    std::scoped_lock lock(m_mutex);
+    if (!m_started)
+        start();
+
+    Reader& reader = m_readers.at(reader_id);
+    ChannelBuffer& buffer = m_channels.at(reader.channel);
+
+    // Whichever reader gets ahead of the others drives the decoding
+    while (reader.frame + num_frames > m_frames_decoded && !m_ended) {
+        decode_block(num_frames);
+    }
+
+    auto frames_read = static_cast<uint32_t>(
+        std::min<uint64_t>(num_frames, m_frames_decoded - reader.frame));
+    size_t num_samples = static_cast<size_t>(frames_read) * m_num_channels;
+
+    if (buffer.silent) {
+        std::fill_n(out, num_samples, 0.0f);
+        reader.frame += frames_read;
+    } else if (buffer.stem) {
+        const float* src = buffer.stem->data() + reader.frame * m_num_channels;
+        std::copy_n(src, num_samples, out);
+        reader.frame += frames_read;
+    } else {
+        auto offset = (reader.frame - buffer.start_frame) * m_num_channels;
+        std::copy_n(buffer.samples.cbegin() + offset, num_samples, out);
+        reader.frame += frames_read;
+        discard_consumed(buffer, reader.channel);
+    }
+
+    return frames_read;
+}
+
+bool MidiSynth::is_playing(int reader_id) const {
+    std::scoped_lock lock(m_mutex);
+    return !m_ended || m_readers.at(reader_id).frame < m_frames_decoded;
+}
+
+void MidiSynth::seek(uint64_t frame) {
+    std::scoped_lock lock(m_mutex);
+    if (!m_started)
+        start();
+
+    // Already there (e.g. seeking to the start before reading anything)
+    bool all_at_frame = std::ranges::all_of(
+        m_readers, [frame](const Reader& reader) { return reader.frame == frame; });
+    if (all_at_frame && m_frames_decoded == frame)
+        return;
+
+    if (m_reading_stems) {
+        frame = std::min(frame, m_frames_decoded);
+    } else {
+        // The stems being written would have a gap (or a repeat) in them
+        m_stem_writers.clear();
+
+        uint64_t byte = frame * m_num_channels * sizeof(float);
+        byte = std::min<uint64_t>(byte,
+                                  BASS_ChannelGetLength(*m_stream_handle, BASS_POS_BYTE));
+        // The channel streams follow the MIDI stream, so they move too. Notes that
+        // started before the new position keep ringing, as they would have.
+        if (!BASS_ChannelSetPosition(
+                *m_stream_handle, byte, BASS_POS_BYTE | BASS_MIDI_DECAYSEEK))
+            throw Error::from_bass_error("Error seeking: ");
+
+        frame = byte / sizeof(float) / m_num_channels;
+        for (auto& [channel, buffer] : m_channels) {
+            buffer.samples.clear();
+            buffer.start_frame = frame;
+        }
+        m_frames_decoded = frame;
+        m_ended = false;
+    }
+
+    for (auto& reader : m_readers) {
+        reader.frame = frame;
+    }
+}
+
+void MidiSynth::seek_reader(int reader_id, uint64_t frame) {
+    std::scoped_lock lock(m_mutex);
+    if (!m_started)
+        start();
+
+    Reader& reader = m_readers.at(reader_id);
+    ChannelBuffer& buffer = m_channels.at(reader.channel);
+    if (!m_reading_stems && frame < buffer.start_frame)
+        throw Error("Can't seek a synth reader back past audio that has been discarded");
+
+    while (frame > m_frames_decoded && !m_ended) {
+        decode_block(SKIP_BLOCK_FRAMES);
+    }
+
+    reader.frame = std::min(frame, m_frames_decoded);
+    if (!m_reading_stems)
+        discard_consumed(buffer, reader.channel);
+}
+
+void MidiSynth::start() {
+    m_started = true;
+    if (!m_stem_cache)
+        return;
+
+    if (open_cached_stems())
+        return;
+
+    // Not cached (or only partially cached); record everything we synthesize. The cache
+    // is purely an optimization, so failing to write it shouldn't stop the render.
+    try {
+        m_stem_writers.emplace(StemCache::MASTER,
+                               m_stem_cache->create_writer(StemCache::MASTER,
+                                                           m_num_channels));
+        for (const auto& [channel, buffer] : m_channels) {
+            if (channel == MASTER_MIX || !needs_stem(channel))
+                continue;
+            m_stem_writers.emplace(channel,
+                                   m_stem_cache->create_writer(channel, m_num_channels));
+        }
+    } catch (const std::exception&) {
+        m_stem_writers.clear();
+    }
+}
+
+// Channels the song never plays a note on are silent, so they aren't worth caching
+bool MidiSynth::needs_stem(int channel) const {
+    return channel < 0 || channel >= NUM_MIDI_CHANNELS || m_used_channels.contains(channel);
+}
+
+bool MidiSynth::open_cached_stems() {
+    bool all_cached = std::ranges::all_of(m_channels, [this](const auto& item) {
+        return !needs_stem(item.first) || m_stem_cache->has_stem(item.first);
+    });
+    if (!all_cached)
+        return false;
+
+    uint64_t num_frames = std::numeric_limits<uint64_t>::max();
+    try {
+        for (auto& [channel, buffer] : m_channels) {
+            if (!needs_stem(channel)) {
+                buffer.silent = true;
+                continue;
+            }
+            buffer.stem.emplace(m_stem_cache->open_stem(channel));
+            if (buffer.stem->get_num_channels() != m_num_channels)
+                throw Error("Cached stem has the wrong number of channels");
+            num_frames = std::min(num_frames, buffer.stem->get_num_frames());
+        }
+    } catch (const Error&) {
+        num_frames = std::numeric_limits<uint64_t>::max();
+    }
+
+    // Without a single stem there's nothing to tell how long the song is
+    if (num_frames == std::numeric_limits<uint64_t>::max()) {
+        for (auto& [channel, buffer] : m_channels) {
+            buffer.stem.reset();
+            buffer.silent = false;
+        }
+        return false;
+    }
+
+    // Everything is already "decoded"
+    m_frames_decoded = num_frames;
+    m_ended = true;
+    m_reading_stems = true;
+    return true;
+}
+
+bool MidiSynth::decode_block(uint32_t num_frames) {
+    m_mix_buffer.resize(static_cast<size_t>(num_frames) * m_num_channels);
+    uint32_t bytes_read =
+        BASS_ChannelGetData(*m_stream_handle,
+                            m_mix_buffer.data(),
+                            (m_mix_buffer.size() * sizeof(float)) | BASS_DATA_FLOAT);
+    if (bytes_read == -1) {
+        int code = BASS_ErrorGetCode();
+        if (code != BASS_ERROR_ENDED)
+            throw Error::from_bass_error("Error getting wave data: ", code);
+
+        m_ended = true;
+        finish_stems();
+        return false;
+    }
+
+    uint32_t frames_read = bytes_read / sizeof(float) / m_num_channels;
+    size_t samples_read = static_cast<size_t>(frames_read) * m_num_channels;
+
+    // Pull the same amount of data out of every channel stream. If a channel stream comes
+    // up short, pad it with silence so every buffer stays frame-aligned with the mix.
+    for (auto& [channel, buffer] : m_channels) {
+        if (channel == MASTER_MIX)
+            continue;
+
+        size_t old_size = buffer.samples.size();
+        buffer.samples.resize(old_size + samples_read, 0.0f);
+        float* chan_samples = buffer.samples.data() + old_size;
+
+        uint32_t chan_bytes = BASS_ChannelGetData(
+            buffer.handle, chan_samples, (samples_read * sizeof(float)) | BASS_DATA_FLOAT);
+        if (chan_bytes == -1 && BASS_ErrorGetCode() != BASS_ERROR_ENDED)
+            throw Error::from_bass_error("Error getting channel wave data: ");
+
+        if (auto it = m_stem_writers.find(channel); it != m_stem_writers.end()) {
+            it->second.write(chan_samples, frames_read);
+        }
+
+        // Split off from the stream's own output, so it has to be added back in
+        for (size_t i = 0; i < samples_read; i++) {
+            m_mix_buffer[i] += chan_samples[i];
+        }
+    }
+
+    if (auto it = m_stem_writers.find(StemCache::MASTER); it != m_stem_writers.end()) {
+        it->second.write(m_mix_buffer.data(), frames_read);
+    }
+
+    if (auto it = m_channels.find(MASTER_MIX); it != m_channels.end()) {
+        auto& samples = it->second.samples;
+        auto mix_end = m_mix_buffer.cbegin() + static_cast<ptrdiff_t>(samples_read);
+        samples.insert(samples.end(), m_mix_buffer.cbegin(), mix_end);
+    }
+
+    m_frames_decoded += frames_read;
+    return true;
+}
+
+void MidiSynth::finish_stems() {
+    for (auto& [channel, writer] : m_stem_writers) {
+        writer.finish();
+    }
+    m_stem_writers.clear();
+}
+
+void MidiSynth::discard_consumed(ChannelBuffer& buffer, int channel) {
+    uint64_t min_frame = std::numeric_limits<uint64_t>::max();
+    for (const auto& reader : m_readers) {
+        if (reader.channel == channel)
+            min_frame = std::min(min_frame, reader.frame);
+    }
+
+    if (min_frame <= buffer.start_frame)
+        return;
+
+    auto num_samples = (min_frame - buffer.start_frame) * m_num_channels;
+    buffer.samples.erase(buffer.samples.begin(), buffer.samples.begin() + num_samples);
+    buffer.start_frame = min_frame;
+}
+
+} // namespace osmium
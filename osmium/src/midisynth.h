@@ -0,0 +1,156 @@
+#ifndef MIDISYNTH_H
+#define MIDISYNTH_H
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "handlewrapper.h"
+#include "mididocument.h"
+#include "soundfont.h"
+#include "stemcache.h"
+
+namespace osmium {
+
+/** Synthesizes a MIDI file once and splits the result into per-channel sample streams.
+ *
+ *  Each consumer registers a reader for the MIDI channel it's interested in, then pulls
+ *  samples from it with `read()`. Whenever a reader runs out of buffered samples, the
+ *  whole song is decoded one block further and the output of every registered channel is
+ *  buffered. Samples are discarded once every reader of a channel has consumed them, so
+ *  memory use stays bounded as long as the readers advance at roughly the same pace.
+ *
+ *  Since the MIDI stream is a decoding channel, BASSMIDI moves the audio of each channel
+ *  (or effects bus) a reader is registered for out of the stream's own output and into
+ *  that channel's stream. The master mix is rebuilt by adding them all back together.
+ *
+ *  If a stem cache is enabled, the synthesized output of every registered channel the
+ *  song plays notes on (plus the effects buses and the master mix) is written to disk as
+ *  it's decoded. Later synths of the same song with the same soundfonts read the cached
+ *  stems instead of synthesizing anything; channels without notes are read as silence.
+ *
+ *  All public methods are thread-safe.
+ */
+class MidiSynth {
+public:
+    static constexpr int NUM_MIDI_CHANNELS = 16;
+    // Pseudo-channels carrying the output of the shared chorus and reverb effects
+    static constexpr int CHORUS_BUS = NUM_MIDI_CHANNELS;
+    static constexpr int REVERB_BUS = NUM_MIDI_CHANNELS + 1;
+    // Pseudo-channel carrying the full mix, effects included: the stream's own output plus
+    // every channel stream split off from it
+    static constexpr int MASTER_MIX = StemCache::MASTER;
+
+    /** Synthesizes at `sample_rate`, or the rate passed to `osmium::init()` if it's 0. */
+    MidiSynth(const char* filename,
+              const std::vector<std::string>& soundfonts = {},
+              bool mmap_soundfonts = false,
+              uint32_t sample_rate = 0,
+              const SynthQuality& quality = {});
+
+    MidiSynth(const MidiSynth&) = delete;
+    MidiSynth& operator=(const MidiSynth&) = delete;
+
+    uint32_t get_sample_rate() const { return m_sample_rate; }
+    uint32_t get_num_channels() const { return m_num_channels; }
+    /** In samples, or the largest `uint64_t` if BASS can't tell. */
+    uint64_t get_total_samples() const;
+
+    /** Identifies the audio this synth produces (the MIDI file, soundfonts and synth
+     *  settings), for keying caches.
+     */
+    uint64_t get_source_key() const;
+
+    /** The events of the MIDI file, read from the synth's own stream the first time this
+     *  is called, so the file doesn't have to be parsed again to follow along.
+     */
+    std::shared_ptr<const MidiDocument> get_document();
+
+    /** Loads the soundfont presets the song plays up front, so synthesis doesn't stall
+     *  loading them mid-song. Best called after the readers are added: if they'll all
+     *  read from the stem cache, nothing needs to be loaded.
+     */
+    PreloadReport preload_soundfonts();
+
+    /** Reads from (and writes to) the stem cache under `cache_dir`.
+     *  Must be called before any samples are read.
+     */
+    void enable_stem_cache(const std::filesystem::path& cache_dir);
+
+    /** Registers a new reader for the given MIDI channel (or effects bus, or the master
+     *  mix) and returns its id.
+     *  Readers must be added before any samples are read.
+     */
+    int add_reader(int channel);
+
+    /** Reads up to `num_frames` interleaved frames for `reader` into `out`, which must
+     *  have room for `num_frames * get_num_channels()` floats.
+     *  Returns the number of frames read; 0 means the song has ended.
+     */
+    uint32_t read(int reader, float* out, uint32_t num_frames);
+    bool is_playing(int reader) const;
+
+    /** Moves every reader (and the synthesis itself) to `frame`. */
+    void seek(uint64_t frame);
+
+    /** Moves a single reader to `frame`, without disturbing the others. It can move
+     *  forward as far as it likes (synthesizing whatever it skips over), but it can only
+     *  move back to audio that's still buffered, i.e. not before the frame the slowest
+     *  other reader of its channel is at. To seek further back, `seek()` the whole synth
+     *  first. (Reading cached stems, any reader can seek anywhere.)
+     */
+    void seek_reader(int reader, uint64_t frame);
+
+private:
+    struct ChannelBuffer {
+        uint32_t handle;
+        std::vector<float> samples; // Interleaved
+        uint64_t start_frame = 0;   // Frame index of samples[0]
+        std::optional<Stem> stem;   // If set, samples come from here instead
+        bool silent = false;        // Reading from stems, but the song never plays it
+    };
+
+    struct Reader {
+        int channel;
+        uint64_t frame = 0;
+    };
+
+    mutable std::mutex m_mutex;
+    HandleWrapper m_stream_handle;
+    std::string m_filename;
+    std::vector<std::string> m_soundfont_filenames;
+    std::vector<std::shared_ptr<SoundFont>> m_soundfonts;
+    std::shared_ptr<const MidiDocument> m_document;
+    SynthQuality m_quality;
+    uint32_t m_sample_rate;
+    uint32_t m_num_channels;
+
+    std::optional<StemCache> m_stem_cache;
+    std::map<int, StemWriter> m_stem_writers;
+    std::set<int> m_used_channels;
+    bool m_reading_stems = false;
+
+    std::map<int, ChannelBuffer> m_channels;
+    std::vector<Reader> m_readers;
+    std::vector<float> m_mix_buffer;
+    uint64_t m_frames_decoded = 0;
+    bool m_started = false;
+    bool m_ended = false;
+
+    void start();
+    bool needs_stem(int channel) const;
+    bool open_cached_stems();
+    bool decode_block(uint32_t num_frames);
+    void finish_stems();
+    void discard_consumed(ChannelBuffer& buffer, int channel);
+};
+
+} // namespace osmium
+
+#endif // MIDISYNTH_H
@@ -0,0 +1,120 @@
+#include "notetracker.h"
+
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "mididocument.h"
+
+namespace osmium {
+
+namespace {
+
+double note_frequency(double note) {
+    return 440.0 * std::exp2((note - 69.0) / 12.0);
+}
+
+} // namespace
+
+NoteTracker::NoteTracker(const std::vector<Event>& events,
+                         const std::vector<double>& times,
+                         uint32_t channel)
+    : m_is_drums(is_gm_drum_channel(channel)),
+      m_starts_as_drums(m_is_drums) {
+    for (size_t i = 0; i < events.size() && i < times.size(); i++) {
+        if (events[i].chan == channel) {
+            m_events.push_back(events[i]);
+            m_times.push_back(times[i]);
+        }
+    }
+}
+
+void NoteTracker::advance_to(double seconds) {
+    for (; m_event_index < m_events.size(); m_event_index++) {
+        if (m_times[m_event_index] >= seconds)
+            break;
+        apply(m_events[m_event_index]);
+    }
+}
+
+void NoteTracker::rewind() {
+    m_event_index = 0;
+    m_held.fill(0);
+    m_sustained.fill(false);
+    m_sustain = false;
+    m_is_drums = m_starts_as_drums;
+    m_pitch_bend = 8192;
+    m_pitch_range = 2;
+    m_fine_tune = 8192;
+    m_coarse_tune = 64;
+}
+
+std::optional<double> NoteTracker::get_lowest_frequency() const {
+    if (m_is_drums)
+        return std::nullopt;
+
+    for (int key = 0; key < 128; key++) {
+        if (m_held[key] > 0 || m_sustained[key]) {
+            double bend = (m_pitch_bend - 8192.0) / 8192.0 * m_pitch_range;
+            double fine_tune = (m_fine_tune - 8192.0) / 8192.0;
+            double coarse_tune = m_coarse_tune - 64.0;
+            return note_frequency(key + bend + fine_tune + coarse_tune);
+        }
+    }
+
+    return std::nullopt;
+}
+
+void NoteTracker::apply(const Event& event) {
+    switch (event.event) {
+    case Event::Note: {
+        // Key in the low byte, velocity in the high byte; a velocity of 0 is a release
+        uint32_t key = event.param & 0xFF;
+        uint32_t velocity = (event.param >> 8) & 0xFF;
+        if (key >= 128)
+            break;
+
+        if (velocity > 0) {
+            m_held[key]++;
+            m_sustained[key] = false;
+        } else if (m_held[key] > 0) {
+            m_held[key]--;
+            if (m_held[key] == 0 && m_sustain) {
+                m_sustained[key] = true;
+            }
+        }
+        break;
+    }
+    case Event::PitchBend:
+        m_pitch_bend = event.param;
+        break;
+    case Event::PitchRange:
+        m_pitch_range = event.param;
+        break;
+    case Event::Drums:
+        m_is_drums = event.param != 0;
+        break;
+    case Event::FineTune:
+        m_fine_tune = event.param;
+        break;
+    case Event::CoarseTune:
+        m_coarse_tune = event.param;
+        break;
+    case Event::Sustain:
+        m_sustain = event.param >= 64;
+        if (!m_sustain) {
+            m_sustained.fill(false);
+        }
+        break;
+    case Event::SoundOff:
+    case Event::NotesOff:
+        m_held.fill(0);
+        m_sustained.fill(false);
+        break;
+    default:
+        break;
+    }
+}
+
+} // namespace osmium
@@ -0,0 +1,58 @@
+#ifndef NOTETRACKER_H
+#define NOTETRACKER_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "mididocument.h"
+
+namespace osmium {
+
+/** Follows the notes held down on a single MIDI channel over time, along with the
+ *  channel's pitch bend and tuning, so a `Scope` can predict the period of the waveform
+ *  it's looking at.
+ */
+class NoteTracker {
+public:
+    /** `events` and `times` are the whole file's events and their times in seconds, as
+     *  returned by `MidiDocument::get_events()` and `get_event_times()`.
+     */
+    NoteTracker(const std::vector<Event>& events,
+                const std::vector<double>& times,
+                uint32_t channel);
+
+    /** Applies every event before `seconds`. Time can only move forward. */
+    void advance_to(double seconds);
+
+    /** Goes back to the start of the song, before any events were applied. */
+    void rewind();
+
+    /** The fundamental frequency (in Hz) of the lowest note currently held, or nothing if
+     *  no notes are held or the channel is a drum channel.
+     */
+    std::optional<double> get_lowest_frequency() const;
+
+private:
+    std::vector<Event> m_events;
+    std::vector<double> m_times;
+    size_t m_event_index = 0;
+
+    std::array<uint8_t, 128> m_held{};   // # of times each key is currently held
+    std::array<bool, 128> m_sustained{}; // Released while the sustain pedal was down
+    bool m_sustain = false;
+    bool m_is_drums;
+    bool m_starts_as_drums;
+
+    uint32_t m_pitch_bend = 8192; // 0-16383; 8192 = no bend
+    uint32_t m_pitch_range = 2;   // Semitones of bend at either extreme
+    uint32_t m_fine_tune = 8192;  // 0-16383; 8192 = no change, extremes = +-1 semitone
+    uint32_t m_coarse_tune = 64;  // Semitones; 64 = no change
+
+    void apply(const Event& event);
+};
+
+} // namespace osmium
+
+#endif // NOTETRACKER_H
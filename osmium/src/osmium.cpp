@@ -1,5 +1,6 @@
 #include "osmium.h"
 
+#include <cstdint>
 #include <iostream>
 
 #include <bass.h>
@@ -11,18 +12,19 @@ namespace {
 HPLUGIN g_midi_plugin = 0;
 } // namespace
 
-bool init() {
+bool init(uint32_t sample_rate) {
     g_midi_plugin = BASS_PluginLoad("bassmidi", 0);
     if (!g_midi_plugin) {
         std::cout << "Error initializing bassmidi (code " << BASS_ErrorGetCode() << ")\n";
         return false;
     }
 
-    // TODO: User-configurable sample rate?
-    return BASS_Init(0, 48000, BASS_DEVICE_STEREO, 0, nullptr);
+    return BASS_Init(0, sample_rate, BASS_DEVICE_STEREO, 0, nullptr);
 }
 
 void uninit() {
+    // Cached soundfonts have to be freed while bassmidi is still loaded
+    release_unused_soundfonts();
     BASS_PluginFree(g_midi_plugin);
     BASS_Free();
 }
@@ -1,15 +1,33 @@
 #ifndef OSMIUM_H
 #define OSMIUM_H
 
+#include <cstdint>
+
+#include "decimator.h"    // IWYU pragma: export
 #include "error.h"        // IWYU pragma: export
 #include "eventtracker.h" // IWYU pragma: export
+#include "mididocument.h" // IWYU pragma: export
+#include "midisynth.h"    // IWYU pragma: export
+#include "notetracker.h"  // IWYU pragma: export
 #include "player.h"       // IWYU pragma: export
+#include "samplesource.h" // IWYU pragma: export
 #include "scope.h"        // IWYU pragma: export
 #include "scopebuilder.h" // IWYU pragma: export
+#include "similarity.h"   // IWYU pragma: export
+#include "soundfont.h"    // IWYU pragma: export
+#include "stemcache.h"    // IWYU pragma: export
+#include "triggerstats.h" // IWYU pragma: export
+#include "triggersweep.h" // IWYU pragma: export
+#include "triggertrack.h" // IWYU pragma: export
 
 namespace osmium {
 
-bool init();
+constexpr uint32_t DEFAULT_SAMPLE_RATE = 48000;
+
+/** Sets up BASS. `sample_rate` is the rate streams are synthesized and decoded at unless
+ *  they ask for another one.
+ */
+bool init(uint32_t sample_rate = DEFAULT_SAMPLE_RATE);
 void uninit();
 
 } // namespace osmium
@@ -1,68 +1,84 @@
 #include "player.h"
 
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
 #include <bass.h>
 #include <bassmidi.h>
 
 #include "error.h"
+#include "soundfont.h"
 
 namespace osmium {
 
-Player::Player(uint32_t handle, uint32_t fps, const char* soundfont)
-    : m_stream_handle(handle) {
+namespace {
+
+constexpr uint32_t PLAYER_FLAGS =
+    BASS_SAMPLE_FLOAT | BASS_STREAM_DECODE | BASS_MIDI_DECAYEND;
+
+std::unique_ptr<BassSource> make_stream_source(uint32_t handle) {
     if (!handle)
         throw Error::from_bass_error("Error creating player: ");
+    return std::make_unique<BassSource>(handle);
+}
+
+std::unique_ptr<SynthMixSource> make_mix_source(const std::shared_ptr<MidiSynth>& synth,
+                                                bool mix_effects) {
+    std::vector<int> channels;
+    for (int channel = 0; channel < MidiSynth::NUM_MIDI_CHANNELS; channel++) {
+        channels.push_back(channel);
+    }
 
-    BASS_CHANNELINFO info;
-    if (!BASS_ChannelGetInfo(handle, &info))
-        throw Error::from_bass_error("Error getting channel info: ");
+    // The channel streams are dry, so the effects buses have to be mixed in separately
+    // to reconstruct the full mix
+    if (mix_effects) {
+        channels.push_back(MidiSynth::CHORUS_BUS);
+        channels.push_back(MidiSynth::REVERB_BUS);
+    }
 
-    m_num_channels = info.chans;
-    m_sample_rate = info.freq;
-    m_samples_per_frame = info.freq / fps;
+    return std::make_unique<SynthMixSource>(synth, channels);
+}
+
+} // namespace
+
+Player::Player(std::unique_ptr<SampleSource> source, uint32_t fps)
+    : m_source(std::move(source)) {
+    m_num_channels = m_source->get_num_channels();
+    m_sample_rate = m_source->get_sample_rate();
+    m_samples_per_frame = m_sample_rate / fps;
     m_buffer.resize(static_cast<size_t>(m_samples_per_frame) * m_num_channels);
+}
 
+Player::Player(uint32_t handle, uint32_t fps, const char* soundfont)
+    : Player(make_stream_source(handle), fps) {
     if (soundfont) {
-        HSOUNDFONT sf_handle = BASS_MIDI_FontInit(soundfont, 0);
-        if (!sf_handle)
-            throw Error::from_bass_error("Error initializing soundfont: ");
-
-        m_stream_handle.set_soundfonts({sf_handle});
+        auto& source = static_cast<BassSource&>(*m_source);
+        source.get_handle().set_soundfonts({load_soundfont(soundfont)});
     }
 }
 
 Player::Player(const char* filename, uint32_t fps, const char* soundfont)
-    : Player(BASS_MIDI_StreamCreateFile(BASS_FILE_NAME,
-                                        filename,
-                                        0,
-                                        0,
-                                        BASS_SAMPLE_FLOAT | BASS_STREAM_DECODE
-                                            | BASS_MIDI_DECAYEND,
-                                        0),
+    : Player(BASS_MIDI_StreamCreateFile(BASS_FILE_NAME, filename, 0, 0, PLAYER_FLAGS, 0),
              fps,
              soundfont) {}
 
+Player::Player(const std::shared_ptr<MidiSynth>& synth, uint32_t fps, bool mix_effects)
+    : Player(make_mix_source(synth, mix_effects), fps) {}
+
 bool Player::is_playing() const {
-    return BASS_ChannelIsActive(*m_stream_handle) == BASS_ACTIVE_PLAYING;
+    return m_source->is_playing();
 }
 
 void Player::next_wave_data() {
-    std::vector<float> data(static_cast<size_t>(m_samples_per_frame) * m_num_channels);
-    uint32_t bytes_read =
-        BASS_ChannelGetData(*m_stream_handle,
-                            data.data(),
-                            data.size() * sizeof(float) | BASS_DATA_FLOAT);
-    if (bytes_read == -1) {
-        int errcode = BASS_ErrorGetCode();
-        if (errcode != BASS_ERROR_ENDED)
-            throw Error::from_bass_error("Error getting sample data: ", errcode);
-
-        std::fill(m_buffer.begin(), m_buffer.end(), 0.0f);
-        return;
-    }
-    uint32_t samples_read = bytes_read / sizeof(float);
-    auto it = std::copy(data.cbegin(), data.cbegin() + samples_read, m_buffer.begin());
-    std::fill(it, m_buffer.end(), 0.0f);
-    // m_buffer.assign(data.cbegin(), data.cbegin() + samples_read);
+    uint32_t frames_read = m_source->read(m_buffer.data(), m_samples_per_frame);
+    std::fill(m_buffer.begin() + static_cast<size_t>(frames_read) * m_num_channels,
+              m_buffer.end(),
+              0.0f);
 }
 
 } // namespace osmium
@@ -2,17 +2,29 @@
 #define PLAYER_H
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
-#include "handlewrapper.h"
+#include "midisynth.h"
+#include "samplesource.h"
 
 namespace osmium {
 
 class Player {
 public:
+    Player(std::unique_ptr<SampleSource> source, uint32_t fps);
     Player(uint32_t handle, uint32_t fps, const char* soundfont = nullptr);
     Player(const char* filename, uint32_t fps, const char* soundfont = nullptr);
 
+    /** Creates a player that mixes down the per-channel output of `synth` rather than
+     *  synthesizing the song separately. This keeps the audio sample-aligned with any
+     *  scopes reading from the same synth. If `mix_effects` is false, the chorus and
+     *  reverb buses are left out of the mix.
+     */
+    Player(const std::shared_ptr<MidiSynth>& synth,
+           uint32_t fps,
+           bool mix_effects = true);
+
     const std::vector<float>& get_samples() const { return m_buffer; }
     uint32_t get_sample_rate() const { return m_sample_rate; }
     uint32_t get_num_channels() const { return m_num_channels; }
@@ -20,7 +32,7 @@ public:
     void next_wave_data();
 
 private:
-    HandleWrapper m_stream_handle;
+    std::unique_ptr<SampleSource> m_source;
     uint32_t m_samples_per_frame;
     uint32_t m_sample_rate;
     uint32_t m_num_channels;
@@ -0,0 +1,53 @@
+#include "samplehistory.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+
+namespace osmium {
+
+void SampleHistory::resize(size_t size) {
+    m_size = size;
+    m_head = 0;
+    m_buffer.assign(size * 2, 0.0f);
+}
+
+void SampleHistory::clear() {
+    m_head = 0;
+    std::ranges::fill(m_buffer, 0.0f);
+}
+
+void SampleHistory::push(std::span<const float> samples) {
+    // Anything older than the last `m_size` samples would be overwritten anyway
+    if (samples.size() > m_size) {
+        samples = samples.last(m_size);
+    }
+
+    write(samples.data(), samples.size());
+}
+
+void SampleHistory::push_zeros(size_t count) {
+    count = std::min(count, m_size);
+
+    size_t first = std::min(count, m_size - m_head);
+    std::fill_n(m_buffer.begin() + m_head, first, 0.0f);
+    std::fill_n(m_buffer.begin() + m_head + m_size, first, 0.0f);
+    std::fill_n(m_buffer.begin(), count - first, 0.0f);
+    std::fill_n(m_buffer.begin() + m_size, count - first, 0.0f);
+
+    m_head = m_size == 0 ? 0 : (m_head + count) % m_size;
+}
+
+void SampleHistory::write(const float* samples, size_t count) {
+    // The new samples replace the oldest ones, starting at the head and wrapping around
+    // to the start of the ring if necessary. Both halves of the mirror get a copy.
+    size_t first = std::min(count, m_size - m_head);
+    std::copy_n(samples, first, m_buffer.begin() + m_head);
+    std::copy_n(samples, first, m_buffer.begin() + m_head + m_size);
+    std::copy_n(samples + first, count - first, m_buffer.begin());
+    std::copy_n(samples + first, count - first, m_buffer.begin() + m_size);
+
+    m_head = m_size == 0 ? 0 : (m_head + count) % m_size;
+}
+
+} // namespace osmium
@@ -0,0 +1,48 @@
+#ifndef SAMPLEHISTORY_H
+#define SAMPLEHISTORY_H
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace osmium {
+
+/** A fixed-size window over the most recent samples of a stream.
+ *
+ *  Samples are kept in a ring buffer backed by twice as much storage, with every sample
+ *  written to both halves. This "mirror" makes the whole window readable as a single
+ *  contiguous array no matter where the ring currently starts, while appending only
+ *  costs as much as the samples being appended.
+ */
+class SampleHistory {
+public:
+    SampleHistory() = default;
+    explicit SampleHistory(size_t size) { resize(size); }
+
+    /** Changes the window size and fills it with zeros. */
+    void resize(size_t size);
+    /** Fills the window with zeros, keeping its size. */
+    void clear();
+    size_t size() const { return m_size; }
+
+    /** Appends `samples`, dropping the same number of the oldest samples. */
+    void push(std::span<const float> samples);
+    /** Appends `count` zeros. */
+    void push_zeros(size_t count);
+
+    /** The current window, from oldest to newest. Invalidated by the next push. */
+    std::span<const float> view() const { return {m_buffer.data() + m_head, m_size}; }
+    const float* data() const { return m_buffer.data() + m_head; }
+    float operator[](size_t i) const { return m_buffer[m_head + i]; }
+
+private:
+    std::vector<float> m_buffer;
+    size_t m_size = 0;
+    size_t m_head = 0; // Index of the oldest sample
+
+    void write(const float* samples, size_t count);
+};
+
+} // namespace osmium
+
+#endif // SAMPLEHISTORY_H
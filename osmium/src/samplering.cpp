@@ -0,0 +1,55 @@
+#include "samplering.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace osmium {
+
+SampleRing::SampleRing(size_t capacity)
+    : m_buffer(capacity), m_write_pos(0), m_read_pos(0) {}
+
+size_t SampleRing::readable() const {
+    // Whichever position belongs to the caller can't change under it, and the other one
+    // only moves in the direction that makes the caller's answer an underestimate
+    uint64_t read_pos = m_read_pos.load();
+    uint64_t write_pos = m_write_pos.load();
+    return static_cast<size_t>(write_pos - read_pos);
+}
+
+size_t SampleRing::write(const float* samples, size_t count) {
+    uint64_t write_pos = m_write_pos.load(std::memory_order_relaxed);
+    uint64_t read_pos = m_read_pos.load(std::memory_order_acquire);
+    count = std::min(count, capacity() - static_cast<size_t>(write_pos - read_pos));
+
+    // Copy in up to two pieces: up to the end of the buffer, then from the start
+    size_t start = write_pos % capacity();
+    size_t first = std::min(count, capacity() - start);
+    std::copy_n(samples, first, m_buffer.begin() + start);
+    std::copy_n(samples + first, count - first, m_buffer.begin());
+
+    m_write_pos.store(write_pos + count);
+    return count;
+}
+
+size_t SampleRing::read(float* out, size_t count) {
+    uint64_t read_pos = m_read_pos.load(std::memory_order_relaxed);
+    uint64_t write_pos = m_write_pos.load(std::memory_order_acquire);
+    count = std::min(count, static_cast<size_t>(write_pos - read_pos));
+
+    size_t start = read_pos % capacity();
+    size_t first = std::min(count, capacity() - start);
+    std::copy_n(m_buffer.cbegin() + start, first, out);
+    std::copy_n(m_buffer.cbegin(), count - first, out + first);
+
+    m_read_pos.store(read_pos + count);
+    return count;
+}
+
+void SampleRing::clear() {
+    m_write_pos = 0;
+    m_read_pos = 0;
+}
+
+} // namespace osmium
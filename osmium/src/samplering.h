@@ -0,0 +1,53 @@
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace osmium {
+
+/** A fixed-capacity FIFO of samples shared by exactly one producer thread and one
+ *  consumer thread, without locks.
+ *
+ *  The read and write positions only ever increase; each side owns one of them and only
+ *  reads the other. Neither `write()` nor `read()` blocks or allocates. They just move as
+ *  many samples as fit (or are there), so waiting for room or data is up to the caller.
+ *  Positions are published with sequentially consistent stores, so a caller that checks
+ *  whether the other side is asleep right after moving its own position can't miss it.
+ */
+class SampleRing {
+public:
+    explicit SampleRing(size_t capacity);
+
+    size_t capacity() const { return m_buffer.size(); }
+    /** Samples waiting to be read. The other thread can only make this grow, so it's
+     *  safe for the consumer to rely on.
+     */
+    size_t readable() const;
+    /** Room for more samples. Likewise safe for the producer to rely on. */
+    size_t writable() const { return capacity() - readable(); }
+
+    /** Producer only. Appends up to `count` samples; returns how many fit. */
+    size_t write(const float* samples, size_t count);
+    /** Consumer only. Takes up to `count` samples; returns how many there were. */
+    size_t read(float* out, size_t count);
+
+    /** Empties the ring. Neither side may be using it at the time. */
+    void clear();
+
+private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    std::vector<float> m_buffer;
+
+    // On separate cache lines, so the two threads don't keep stealing them from each
+    // other
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_write_pos;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_read_pos;
+};
+
+} // namespace osmium
+
+#endif // SAMPLERING_H
@@ -0,0 +1,503 @@
+#include "samplesource.h"
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <bass.h>
+#include <bassmidi.h>
+
+#include "error.h"
+
+namespace osmium {
+
+namespace {
+
+template<typename T>
+T read_le(const std::byte* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+bool chunk_id_is(const std::byte* p, const char* id) {
+    return std::memcmp(p, id, 4) == 0;
+}
+
+} // namespace
+
+// -- SampleSource --
+
+void SampleSource::seek(uint64_t /*frame*/) {
+    throw Error("This sample source can't seek");
+}
+
+// -- BassSource --
+
+BassSource::BassSource(uint32_t handle) : m_handle(handle) {
+    BASS_CHANNELINFO info;
+    if (!BASS_ChannelGetInfo(handle, &info))
+        throw Error::from_bass_error("Error getting channel info: ");
+
+    m_sample_rate = info.freq;
+    m_num_channels = info.chans;
+    m_is_midi = info.ctype == BASS_CTYPE_STREAM_MIDI;
+}
+
+uint64_t BassSource::get_total_samples() const {
+    QWORD num_bytes = BASS_ChannelGetLength(*m_handle, BASS_POS_BYTE);
+    if (num_bytes == static_cast<QWORD>(-1))
+        return UNKNOWN_LENGTH;
+    return num_bytes / sizeof(float);
+}
+
+uint32_t BassSource::read(float* out, uint32_t num_frames) {
+    size_t num_bytes = static_cast<size_t>(num_frames) * m_num_channels * sizeof(float);
+    uint32_t bytes_read =
+        BASS_ChannelGetData(*m_handle, out, num_bytes | BASS_DATA_FLOAT);
+    if (bytes_read == -1) {
+        int code = BASS_ErrorGetCode();
+        if (code != BASS_ERROR_ENDED)
+            throw Error::from_bass_error("Error getting wave data: ", code);
+        return 0;
+    }
+
+    return bytes_read / sizeof(float) / m_num_channels;
+}
+
+bool BassSource::is_playing() const {
+    return BASS_ChannelIsActive(*m_handle) == BASS_ACTIVE_PLAYING;
+}
+
+void BassSource::seek(uint64_t frame) {
+    uint64_t byte = frame * m_num_channels * sizeof(float);
+    byte = std::min<uint64_t>(byte, BASS_ChannelGetLength(*m_handle, BASS_POS_BYTE));
+
+    // Let notes that started before the new position ring out, rather than starting
+    // from silence
+    uint32_t mode = BASS_POS_BYTE | (m_is_midi ? BASS_MIDI_DECAYSEEK : 0);
+    if (!BASS_ChannelSetPosition(*m_handle, byte, mode))
+        throw Error::from_bass_error("Error seeking: ");
+}
+
+// -- MemorySource --
+
+MemorySource::MemorySource(std::vector<float> samples,
+                           uint32_t sample_rate,
+                           uint32_t num_channels)
+    : MemorySource(std::make_shared<const std::vector<float>>(std::move(samples)),
+                   sample_rate,
+                   num_channels) {}
+
+MemorySource::MemorySource(std::shared_ptr<const std::vector<float>> samples,
+                           uint32_t sample_rate,
+                           uint32_t num_channels)
+    : m_samples(std::move(samples)),
+      m_sample_rate(sample_rate),
+      m_num_channels(num_channels) {
+    if (num_channels == 0)
+        throw Error("A sample source needs at least one channel");
+}
+
+uint32_t MemorySource::read(float* out, uint32_t num_frames) {
+    uint64_t frames_left = m_samples->size() / m_num_channels - m_frame;
+    auto frames_read = static_cast<uint32_t>(std::min<uint64_t>(num_frames, frames_left));
+
+    std::copy_n(m_samples->cbegin() + m_frame * m_num_channels,
+                static_cast<size_t>(frames_read) * m_num_channels,
+                out);
+    m_frame += frames_read;
+    return frames_read;
+}
+
+bool MemorySource::is_playing() const {
+    return m_frame < m_samples->size() / m_num_channels;
+}
+
+void MemorySource::seek(uint64_t frame) {
+    m_frame = std::min<uint64_t>(frame, m_samples->size() / m_num_channels);
+}
+
+// -- StemSource --
+
+StemSource::StemSource(Stem stem) : m_stem(std::move(stem)) {}
+
+StemSource::StemSource(const std::filesystem::path& path) : m_stem(path) {}
+
+uint64_t StemSource::get_total_samples() const {
+    return m_stem.get_num_frames() * m_stem.get_num_channels();
+}
+
+uint32_t StemSource::read(float* out, uint32_t num_frames) {
+    uint64_t frames_left = m_stem.get_num_frames() - m_frame;
+    auto frames_read = static_cast<uint32_t>(std::min<uint64_t>(num_frames, frames_left));
+    uint32_t num_channels = m_stem.get_num_channels();
+
+    std::copy_n(m_stem.data() + m_frame * num_channels,
+                static_cast<size_t>(frames_read) * num_channels,
+                out);
+    m_frame += frames_read;
+    return frames_read;
+}
+
+bool StemSource::is_playing() const {
+    return m_frame < m_stem.get_num_frames();
+}
+
+void StemSource::seek(uint64_t frame) {
+    m_frame = std::min(frame, m_stem.get_num_frames());
+}
+
+// -- WavSource --
+
+WavSource::WavSource(const std::filesystem::path& path) : m_file(path) {
+    const std::byte* data = m_file.data();
+    size_t size = m_file.size();
+    if (size < 12 || !chunk_id_is(data, "RIFF") || !chunk_id_is(data + 8, "WAVE"))
+        throw Error("Not a WAV file: " + path.string());
+
+    bool found_fmt = false;
+    size_t offs = 12;
+    while (offs + 8 <= size) {
+        const std::byte* chunk = data + offs;
+        auto chunk_size = read_le<uint32_t>(chunk + 4);
+        const std::byte* body = chunk + 8;
+        size_t body_size = std::min<size_t>(chunk_size, size - offs - 8);
+
+        if (chunk_id_is(chunk, "fmt ") && body_size >= 16) {
+            auto format = read_le<uint16_t>(body);
+            m_num_channels = read_le<uint16_t>(body + 2);
+            m_sample_rate = read_le<uint32_t>(body + 4);
+            auto bits_per_sample = read_le<uint16_t>(body + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format in its subformat GUID
+            if (format == 0xFFFE && body_size >= 26) {
+                format = read_le<uint16_t>(body + 24);
+            }
+
+            if (format != 3 || bits_per_sample != 32)
+                throw Error("Unsupported WAV format (must be 32-bit float): "
+                            + path.string());
+            found_fmt = true;
+        } else if (chunk_id_is(chunk, "data")) {
+            if (!found_fmt || m_num_channels == 0)
+                throw Error("WAV file has no format chunk: " + path.string());
+
+            m_data = body;
+            m_num_frames = body_size / sizeof(float) / m_num_channels;
+            return;
+        }
+
+        // Chunks are padded to an even number of bytes
+        offs += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    throw Error("WAV file has no data chunk: " + path.string());
+}
+
+uint32_t WavSource::read(float* out, uint32_t num_frames) {
+    uint64_t frames_left = m_num_frames - m_frame;
+    auto frames_read = static_cast<uint32_t>(std::min<uint64_t>(num_frames, frames_left));
+
+    // The data chunk isn't guaranteed to be float-aligned, so copy bytewise
+    size_t frame_bytes = static_cast<size_t>(m_num_channels) * sizeof(float);
+    std::memcpy(out, m_data + m_frame * frame_bytes, frames_read * frame_bytes);
+    m_frame += frames_read;
+    return frames_read;
+}
+
+bool WavSource::is_playing() const {
+    return m_frame < m_num_frames;
+}
+
+void WavSource::seek(uint64_t frame) {
+    m_frame = std::min(frame, m_num_frames);
+}
+
+// -- SynthChannelSource --
+
+SynthChannelSource::SynthChannelSource(std::shared_ptr<MidiSynth> synth, int channel)
+    : m_synth(std::move(synth)) {
+    m_reader = m_synth->add_reader(channel);
+}
+
+uint32_t SynthChannelSource::read(float* out, uint32_t num_frames) {
+    return m_synth->read(m_reader, out, num_frames);
+}
+
+bool SynthChannelSource::is_playing() const {
+    return m_synth->is_playing(m_reader);
+}
+
+void SynthChannelSource::seek(uint64_t frame) {
+    m_synth->seek_reader(m_reader, frame);
+}
+
+// -- SynthMixSource --
+
+SynthMixSource::SynthMixSource(std::shared_ptr<MidiSynth> synth,
+                               const std::vector<int>& channels)
+    : m_synth(std::move(synth)) {
+    for (int channel : channels) {
+        m_readers.push_back(m_synth->add_reader(channel));
+    }
+}
+
+uint32_t SynthMixSource::read(float* out, uint32_t num_frames) {
+    size_t num_samples = static_cast<size_t>(num_frames) * get_num_channels();
+    m_channel_buffer.resize(num_samples);
+    std::fill_n(out, num_samples, 0.0f);
+
+    uint32_t max_frames_read = 0;
+    for (int reader : m_readers) {
+        uint32_t frames_read = m_synth->read(reader, m_channel_buffer.data(), num_frames);
+        size_t samples_read = static_cast<size_t>(frames_read) * get_num_channels();
+        for (size_t i = 0; i < samples_read; i++) {
+            out[i] += m_channel_buffer[i];
+        }
+        max_frames_read = std::max(max_frames_read, frames_read);
+    }
+
+    return max_frames_read;
+}
+
+bool SynthMixSource::is_playing() const {
+    return std::ranges::any_of(m_readers, [this](int reader) {
+        return m_synth->is_playing(reader);
+    });
+}
+
+void SynthMixSource::seek(uint64_t frame) {
+    for (int reader : m_readers) {
+        m_synth->seek_reader(reader, frame);
+    }
+}
+
+// -- DecimatingSource --
+
+DecimatingSource::DecimatingSource(std::unique_ptr<SampleSource> source, uint32_t factor)
+    : m_source(std::move(source)),
+      m_decimator(factor, m_source->get_num_channels()),
+      m_sample_rate(m_source->get_sample_rate() / factor),
+      m_num_channels(m_source->get_num_channels()),
+      m_input(static_cast<size_t>(m_decimator.get_reach()) * m_num_channels, 0.0f),
+      m_input_start(-static_cast<int64_t>(m_decimator.get_reach())) {}
+
+uint64_t DecimatingSource::get_total_samples() const {
+    uint64_t input_samples = m_source->get_total_samples();
+    if (input_samples == UNKNOWN_LENGTH)
+        return UNKNOWN_LENGTH;
+
+    uint64_t input_frames = input_samples / m_num_channels;
+    uint64_t factor = m_decimator.get_factor();
+    return (input_frames + factor - 1) / factor * m_num_channels;
+}
+
+uint32_t DecimatingSource::read(float* out, uint32_t num_frames) {
+    if (num_frames == 0)
+        return 0;
+
+    const int64_t factor = m_decimator.get_factor();
+    const int64_t reach = m_decimator.get_reach();
+    auto first_center = static_cast<int64_t>(m_frame) * factor;
+    fill_input(first_center - reach
+               + static_cast<int64_t>(m_decimator.input_frames_for(num_frames)));
+
+    // Once the source has ended, stop after the last frame centered on real input
+    if (m_source_ended) {
+        auto input_end = static_cast<int64_t>(m_input_end);
+        int64_t frames_left = std::max<int64_t>(
+            (input_end - first_center + factor - 1) / factor, 0);
+        num_frames = static_cast<uint32_t>(std::min<int64_t>(num_frames, frames_left));
+    }
+
+    size_t offset = static_cast<size_t>(first_center - reach - m_input_start);
+    m_decimator.process(m_input.data() + offset * m_num_channels, num_frames, out);
+    m_frame += num_frames;
+
+    // Drop the input no later frame will reach back to
+    auto keep_from = static_cast<int64_t>(m_frame) * factor - reach;
+    auto num_dropped = static_cast<size_t>(std::clamp<int64_t>(
+        keep_from - m_input_start, 0, buffered_end() - m_input_start));
+    m_input.erase(m_input.begin(),
+                  m_input.begin() + static_cast<ptrdiff_t>(num_dropped * m_num_channels));
+    m_input_start += static_cast<int64_t>(num_dropped);
+
+    return num_frames;
+}
+
+bool DecimatingSource::is_playing() const {
+    if (m_frame * m_decimator.get_factor() < m_input_end)
+        return true;
+    return !m_source_ended && m_source->is_playing();
+}
+
+void DecimatingSource::seek(uint64_t frame) {
+    int64_t start = static_cast<int64_t>(frame * m_decimator.get_factor())
+                    - m_decimator.get_reach();
+    uint64_t source_start = std::max<int64_t>(start, 0);
+    m_source->seek(source_start);
+
+    // Whatever the filter reaches back to before the start of the source is silence
+    m_input.assign(static_cast<size_t>(source_start - start) * m_num_channels, 0.0f);
+    m_input_start = start;
+    m_input_end = source_start;
+    m_source_ended = false;
+    m_frame = frame;
+}
+
+int64_t DecimatingSource::buffered_end() const {
+    return m_input_start + static_cast<int64_t>(m_input.size() / m_num_channels);
+}
+
+void DecimatingSource::fill_input(int64_t end) {
+    while (buffered_end() < end && !m_source_ended) {
+        auto to_read = static_cast<uint32_t>(end - buffered_end());
+        size_t old_size = m_input.size();
+        m_input.resize(old_size + static_cast<size_t>(to_read) * m_num_channels);
+
+        uint32_t frames_read = m_source->read(m_input.data() + old_size, to_read);
+        m_input.resize(old_size + static_cast<size_t>(frames_read) * m_num_channels);
+        m_input_end += frames_read;
+        if (frames_read == 0)
+            m_source_ended = true;
+    }
+
+    if (buffered_end() < end) {
+        m_input.resize(m_input.size()
+                           + static_cast<size_t>(end - buffered_end()) * m_num_channels,
+                       0.0f);
+    }
+}
+
+// -- ReadAheadSource --
+
+ReadAheadSource::ReadAheadSource(std::unique_ptr<SampleSource> source,
+                                 uint32_t buffer_frames,
+                                 uint32_t block_frames)
+    : m_source(std::move(source)),
+      m_sample_rate(m_source->get_sample_rate()),
+      m_num_channels(m_source->get_num_channels()),
+      m_total_samples(m_source->get_total_samples()),
+      m_block_size(size_t{std::max<uint32_t>(block_frames, 1)} * m_num_channels),
+      m_ring(std::max<size_t>(static_cast<size_t>(buffer_frames) * m_num_channels,
+                              m_block_size)),
+      m_block(m_block_size) {}
+
+ReadAheadSource::~ReadAheadSource() {
+    stop();
+}
+
+uint32_t ReadAheadSource::read(float* out, uint32_t num_frames) {
+    if (!m_thread.joinable())
+        start();
+
+    size_t wanted = static_cast<size_t>(num_frames) * m_num_channels;
+    size_t got = 0;
+    while (got < wanted) {
+        got += m_ring.read(out + got, wanted - got);
+
+        // Only bother the producer if it's asleep and there's now room for a block
+        if (m_producer_waiting && m_ring.writable() >= m_block_size) {
+            std::scoped_lock lock(m_mutex);
+            m_wakeup.notify_all();
+        }
+
+        if (got < wanted && !wait_for_samples()) {
+            if (got == 0 && m_error)
+                std::rethrow_exception(m_error);
+            break;
+        }
+    }
+
+    return static_cast<uint32_t>(got / m_num_channels);
+}
+
+bool ReadAheadSource::is_playing() const {
+    // Until the thread starts, nothing else is using the source
+    if (!m_thread.joinable())
+        return m_source->is_playing();
+    return wait_for_samples();
+}
+
+void ReadAheadSource::seek(uint64_t frame) {
+    stop();
+    m_source->seek(frame);
+    m_ring.clear();
+    m_source_ended = false;
+    m_error = nullptr;
+    start();
+}
+
+void ReadAheadSource::start() {
+    m_thread = std::jthread([this](const std::stop_token& stop) { produce(stop); });
+}
+
+void ReadAheadSource::stop() {
+    if (!m_thread.joinable())
+        return;
+
+    m_thread.request_stop();
+    m_thread.join();
+}
+
+void ReadAheadSource::produce(const std::stop_token& stop) {
+    try {
+        while (!stop.stop_requested()) {
+            auto block_frames = static_cast<uint32_t>(m_block_size / m_num_channels);
+            uint32_t frames_read = m_source->read(m_block.data(), block_frames);
+            if (frames_read == 0)
+                break;
+
+            size_t block_size = static_cast<size_t>(frames_read) * m_num_channels;
+            if (m_ring.writable() < block_size) {
+                std::unique_lock lock(m_mutex);
+                m_producer_waiting = true;
+                auto has_room = [&] { return m_ring.writable() >= block_size; };
+                m_wakeup.wait(lock, stop, has_room);
+                m_producer_waiting = false;
+                if (stop.stop_requested())
+                    return;
+            }
+
+            m_ring.write(m_block.data(), block_size);
+            if (m_consumer_waiting) {
+                std::scoped_lock lock(m_mutex);
+                m_wakeup.notify_all();
+            }
+        }
+    } catch (...) {
+        m_error = std::current_exception();
+    }
+
+    std::scoped_lock lock(m_mutex);
+    m_source_ended = true;
+    m_wakeup.notify_all();
+}
+
+bool ReadAheadSource::wait_for_samples() const {
+    if (m_ring.readable() > 0)
+        return true;
+
+    std::unique_lock lock(m_mutex);
+    m_consumer_waiting = true;
+    m_wakeup.wait(lock, [this] { return m_ring.readable() > 0 || m_source_ended; });
+    m_consumer_waiting = false;
+    return m_ring.readable() > 0;
+}
+
+} // namespace osmium
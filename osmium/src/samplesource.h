@@ -0,0 +1,273 @@
+#ifndef SAMPLESOURCE_H
+#define SAMPLESOURCE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "decimator.h"
+#include "handlewrapper.h"
+#include "mappedfile.h"
+#include "midisynth.h"
+#include "samplering.h"
+#include "stemcache.h"
+
+namespace osmium {
+
+/** A stream of interleaved float samples that a `Scope` or `Player` can pull from. */
+class SampleSource {
+public:
+    static constexpr uint64_t UNKNOWN_LENGTH = std::numeric_limits<uint64_t>::max();
+
+    SampleSource() = default;
+    SampleSource(const SampleSource&) = delete;
+    SampleSource& operator=(const SampleSource&) = delete;
+    virtual ~SampleSource() = default;
+
+    virtual uint32_t get_sample_rate() const = 0;
+    virtual uint32_t get_num_channels() const = 0;
+
+    /** Total length of the stream, in samples (i.e. frames * channels), or
+     *  `UNKNOWN_LENGTH` if it can't be told up front.
+     */
+    virtual uint64_t get_total_samples() const = 0;
+
+    /** Reads up to `num_frames` frames into `out`, which must have room for
+     *  `num_frames * get_num_channels()` floats. Returns the number of frames read;
+     *  0 means the stream has ended.
+     */
+    virtual uint32_t read(float* out, uint32_t num_frames) = 0;
+    virtual bool is_playing() const = 0;
+
+    /** Moves to `frame`, so that the next `read()` starts there. Seeking past the end
+     *  ends the stream. Throws if the source can't seek.
+     */
+    virtual void seek(uint64_t frame);
+};
+
+/** Reads from a BASS decoding channel, which it takes ownership of. */
+class BassSource : public SampleSource {
+public:
+    explicit BassSource(uint32_t handle);
+
+    HandleWrapper& get_handle() { return m_handle; }
+
+    uint32_t get_sample_rate() const override { return m_sample_rate; }
+    uint32_t get_num_channels() const override { return m_num_channels; }
+    uint64_t get_total_samples() const override;
+    uint32_t read(float* out, uint32_t num_frames) override;
+    bool is_playing() const override;
+    void seek(uint64_t frame) override;
+
+private:
+    HandleWrapper m_handle;
+    uint32_t m_sample_rate;
+    uint32_t m_num_channels;
+    bool m_is_midi;
+};
+
+/** Reads from a buffer of samples held in memory. The buffer may be shared between
+ *  several sources, each with its own read position.
+ */
+class MemorySource : public SampleSource {
+public:
+    MemorySource(std::vector<float> samples, uint32_t sample_rate, uint32_t num_channels);
+    MemorySource(std::shared_ptr<const std::vector<float>> samples,
+                 uint32_t sample_rate,
+                 uint32_t num_channels);
+
+    uint32_t get_sample_rate() const override { return m_sample_rate; }
+    uint32_t get_num_channels() const override { return m_num_channels; }
+    uint64_t get_total_samples() const override { return m_samples->size(); }
+    uint32_t read(float* out, uint32_t num_frames) override;
+    bool is_playing() const override;
+    void seek(uint64_t frame) override;
+
+private:
+    std::shared_ptr<const std::vector<float>> m_samples;
+    uint32_t m_sample_rate;
+    uint32_t m_num_channels;
+    uint64_t m_frame = 0;
+};
+
+/** Reads from a memory-mapped stem file (see `StemCache`). */
+class StemSource : public SampleSource {
+public:
+    explicit StemSource(Stem stem);
+    explicit StemSource(const std::filesystem::path& path);
+
+    uint32_t get_sample_rate() const override { return m_stem.get_sample_rate(); }
+    uint32_t get_num_channels() const override { return m_stem.get_num_channels(); }
+    uint64_t get_total_samples() const override;
+    uint32_t read(float* out, uint32_t num_frames) override;
+    bool is_playing() const override;
+    void seek(uint64_t frame) override;
+
+private:
+    Stem m_stem;
+    uint64_t m_frame = 0;
+};
+
+/** Reads from a memory-mapped WAV file. Only 32-bit float WAVs are supported. */
+class WavSource : public SampleSource {
+public:
+    explicit WavSource(const std::filesystem::path& path);
+
+    uint32_t get_sample_rate() const override { return m_sample_rate; }
+    uint32_t get_num_channels() const override { return m_num_channels; }
+    uint64_t get_total_samples() const override { return m_num_frames * m_num_channels; }
+    uint32_t read(float* out, uint32_t num_frames) override;
+    bool is_playing() const override;
+    void seek(uint64_t frame) override;
+
+private:
+    MappedFile m_file;
+    const std::byte* m_data = nullptr;
+    uint64_t m_num_frames = 0;
+    uint32_t m_sample_rate = 0;
+    uint32_t m_num_channels = 0;
+    uint64_t m_frame = 0;
+};
+
+/** Reads one channel (or effects bus) of a shared `MidiSynth`. Seeking only moves this
+ *  source's reader; see `MidiSynth::seek_reader()`.
+ */
+class SynthChannelSource : public SampleSource {
+public:
+    SynthChannelSource(std::shared_ptr<MidiSynth> synth, int channel);
+
+    uint32_t get_sample_rate() const override { return m_synth->get_sample_rate(); }
+    uint32_t get_num_channels() const override { return m_synth->get_num_channels(); }
+    uint64_t get_total_samples() const override { return m_synth->get_total_samples(); }
+    uint32_t read(float* out, uint32_t num_frames) override;
+    bool is_playing() const override;
+    void seek(uint64_t frame) override;
+
+private:
+    std::shared_ptr<MidiSynth> m_synth;
+    int m_reader;
+};
+
+/** Sums several channels of a shared `MidiSynth` into a single mix. */
+class SynthMixSource : public SampleSource {
+public:
+    SynthMixSource(std::shared_ptr<MidiSynth> synth, const std::vector<int>& channels);
+
+    uint32_t get_sample_rate() const override { return m_synth->get_sample_rate(); }
+    uint32_t get_num_channels() const override { return m_synth->get_num_channels(); }
+    uint64_t get_total_samples() const override { return m_synth->get_total_samples(); }
+    uint32_t read(float* out, uint32_t num_frames) override;
+    bool is_playing() const override;
+    void seek(uint64_t frame) override;
+
+private:
+    std::shared_ptr<MidiSynth> m_synth;
+    std::vector<int> m_readers;
+    std::vector<float> m_channel_buffer;
+};
+
+/** Reads another source at a fraction of its sample rate, low-pass filtered so nothing
+ *  above the new Nyquist frequency aliases back in. Frame `m` of this source lines up
+ *  with frame `m * factor` of the original.
+ */
+class DecimatingSource : public SampleSource {
+public:
+    DecimatingSource(std::unique_ptr<SampleSource> source, uint32_t factor);
+
+    uint32_t get_sample_rate() const override { return m_sample_rate; }
+    uint32_t get_num_channels() const override { return m_num_channels; }
+    uint64_t get_total_samples() const override;
+    uint32_t read(float* out, uint32_t num_frames) override;
+    bool is_playing() const override;
+    void seek(uint64_t frame) override;
+
+private:
+    std::unique_ptr<SampleSource> m_source;
+    Decimator m_decimator;
+    uint32_t m_sample_rate;
+    uint32_t m_num_channels;
+
+    // Input frames from m_input_start on. Frames before the start of the source (while
+    // the filter is still reaching back past it) or after its end are zeros.
+    std::vector<float> m_input;
+    int64_t m_input_start;
+    uint64_t m_input_end = 0; // One past the last frame actually read from the source
+    bool m_source_ended = false;
+    uint64_t m_frame = 0;     // Next output frame
+
+    int64_t buffered_end() const;
+    /** Buffers input up to (not including) frame `end`, padding with zeros past the end
+     *  of the source.
+     */
+    void fill_input(int64_t end);
+};
+
+/** Reads another source ahead on a background thread, so that `read()` normally just
+ *  copies out samples that were decoded earlier instead of waiting for them.
+ *
+ *  The thread keeps up to `buffer_frames` frames decoded, reading `block_frames` at a
+ *  time whenever there's room for a whole block. It isn't started until the first
+ *  `read()` or `seek()`, so wrapping a source doesn't start decoding it; that matters
+ *  for sources like `SynthChannelSource` that can't be set up any further once they've
+ *  been read from. After that, the wrapped source is only ever used from the thread;
+ *  errors it throws are rethrown by `read()` once the samples before them have been
+ *  read.
+ */
+class ReadAheadSource : public SampleSource {
+public:
+    ReadAheadSource(std::unique_ptr<SampleSource> source,
+                    uint32_t buffer_frames,
+                    uint32_t block_frames);
+    ~ReadAheadSource() override;
+
+    uint32_t get_sample_rate() const override { return m_sample_rate; }
+    uint32_t get_num_channels() const override { return m_num_channels; }
+    uint64_t get_total_samples() const override { return m_total_samples; }
+    uint32_t read(float* out, uint32_t num_frames) override;
+    /** Waits for the background thread if it's running and nothing has been decoded
+     *  yet.
+     */
+    bool is_playing() const override;
+    void seek(uint64_t frame) override;
+
+private:
+    std::unique_ptr<SampleSource> m_source;
+    uint32_t m_sample_rate;
+    uint32_t m_num_channels;
+    uint64_t m_total_samples;
+    size_t m_block_size; // In samples
+
+    SampleRing m_ring;
+    std::vector<float> m_block;
+    std::atomic<bool> m_source_ended = false;
+    std::exception_ptr m_error; // Set before m_source_ended
+
+    // Only for sleeping when the ring is empty (consumer) or full (producer)
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable_any m_wakeup;
+    mutable std::atomic<bool> m_consumer_waiting = false;
+    std::atomic<bool> m_producer_waiting = false;
+
+    std::jthread m_thread; // Last, so it stops before anything it uses is destroyed
+
+    void start();
+    void stop();
+    void produce(const std::stop_token& stop);
+    /** Waits until there's something to read or the source has ended. Returns whether
+     *  there's something to read.
+     */
+    bool wait_for_samples() const;
+};
+
+} // namespace osmium
+
+#endif // SAMPLESOURCE_H
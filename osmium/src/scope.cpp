@@ -1,21 +1,24 @@
 #include "scope.h"
 
 #include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <iterator>
 #include <limits>
+#include <memory>
 #include <optional>
-#include <queue>
+#include <span>
+#include <utility>
 #include <vector>
 
-#ifndef NOMINMAX
-#define NOMINMAX
-#endif
-
-#include <bass.h>
-
-#include "error.h"
+#include "alloccount.h"
+#include "conditioning.h"
+#include "crossings.h"
+#include "samplehistory.h"
+#include "similarity.h"
 
 namespace osmium {
 
@@ -23,30 +26,34 @@ namespace osmium {
 
 namespace {
 
-/** "Left-shifts" `src` 's elements into `dest`.
- *  If `src.size() < min_size`, shifts in enough copies of `default_val` until
- *  `min_size` values have been shifted (as if `src` had been padded with
- *  `default_val` until it reached `min_size`).
+// How far (as a fraction of the expected period) a candidate can be from a whole number
+// of periods away from the last frame's nudge, and still be considered in phase
+constexpr double PERIOD_TOLERANCE = 0.05;
+constexpr double MIN_PERIOD_TOLERANCE = 2.0; // Samples
+
+// Time constants of the envelope followers used by the transient trigger. The fast one
+// follows the attack of a hit, the slow one the overall level.
+constexpr double FAST_ENVELOPE_SECONDS = 0.001;
+constexpr double SLOW_ENVELOPE_SECONDS = 0.030;
+// How many times louder than the overall level the attack of a hit has to be. Keeps the
+// normal ups and downs of noise from counting as onsets.
+constexpr float MIN_ONSET_RATIO = 2.0f;
+// Fraction of the strongest onset in the search range to trigger at
+constexpr float ONSET_THRESHOLD = 0.5f;
+
+// Frames to process after refilling the history when seeking, so the trigger has a
+// previous frame (and that one a previous frame...) to line up with
+constexpr uint64_t SEEK_WARMUP_FRAMES = 4;
+
+/** Appends `src` to `dest`. If `src.size() < min_size`, also appends enough zeros to
+ *  make up the difference (as if `src` had been padded with zeros until it reached
+ *  `min_size`).
  */
-template<typename T>
-void shift_in(std::vector<T>& dest,
-              const std::vector<T>& src,
-              size_t min_size,
-              T default_val = 0) {
-    size_t size = std::max(min_size, src.size());
-    size_t src_offset = src.size() > dest.size() ? src.size() - dest.size() : 0;
-
-    // If `dest` won't be completely overwritten, shift back the existing values
-    // in `dest`. `std::copy()` returns an iterator pointing to the element just
-    // after the copied data.
-    auto it = size >= dest.size()
-                  ? dest.begin()
-                  : std::copy(dest.begin() + size, dest.end(), dest.begin());
-
-    // Copy the values from `src` to the point in `dest` just after `std::copy()`
-    // finished, then fill the remainder with `default_val`
-    it = std::copy(src.cbegin() + src_offset, src.cend(), it);
-    std::fill(it, dest.end(), default_val);
+void shift_in(SampleHistory& dest, std::span<const float> src, size_t min_size) {
+    dest.push(src);
+    if (src.size() < min_size) {
+        dest.push_zeros(min_size - src.size());
+    }
 }
 
 // Credit to https://stackoverflow.com/a/2745086/31835764
@@ -71,36 +78,165 @@ It abs_max_element(It begin, It end) {
     return candidate;
 }
 
-template<typename T>
-std::vector<T> stereo_downmix(const std::vector<T>& left, const std::vector<T>& right) {
-    std::vector<T> result(std::min(left.size(), right.size()), 0);
-    for (size_t i = 0; i < result.size(); ++i) {
-        result[i] = (left[i] + right[i]) / 2;
-    }
-    return result;
-}
-
 } // namespace
 
 // --- osmium::Scope implementation ---
 
-Scope::Scope(uint32_t handle, uint32_t window_size, uint32_t internal_size)
-    : m_stream_handle(handle) {
+Scope::Scope(std::unique_ptr<SampleSource> source,
+             uint32_t window_size,
+             uint32_t internal_size)
+    : m_source(std::move(source)) {
     m_left_output.resize(window_size);
     m_left_buffer.resize(internal_size);
     m_right_output.resize(window_size);
     m_right_buffer.resize(internal_size);
 }
 
+void Scope::allocate_scratch() {
+    size_t samples_per_frame = std::max(m_samples_per_frame, 0);
+    size_t max_nudge = std::max(m_max_nudge, 0);
+
+    m_read_buffer.resize(samples_per_frame * m_src_num_channels);
+    m_new_left_samples.resize(samples_per_frame);
+    m_new_right_samples.resize(samples_per_frame);
+    if (m_is_stereo) {
+        m_new_mix_samples.resize(samples_per_frame);
+        m_mix_buffer.resize(m_left_buffer.size());
+        m_downmix_output.resize(m_left_output.size());
+    }
+    // Every frame appends exactly one frame's worth of samples (padded with zeros if
+    // need be) to the buffers
+    m_peak_tracker.reset(m_left_buffer.size(), samples_per_frame);
+
+    if (m_track_path && get_total_samples() == SampleSource::UNKNOWN_LENGTH) {
+        // No telling how much room the track needs
+        m_track_path.reset();
+    }
+    if (m_track_path && samples_per_frame > 0) {
+        // Leave some slack in case the source's reported length is an underestimate
+        uint64_t length = get_total_samples() / m_src_num_channels;
+        uint64_t num_frames = div_ceil<uint64_t>(length, samples_per_frame);
+        m_recorded_nudges.reserve(num_frames + num_frames / 8 + 64);
+    }
+
+    // Candidates are distinct nudge amounts in [0, m_max_nudge), so none of these can
+    // ever hold more than m_max_nudge elements
+    m_base_nudges.reserve(max_nudge);
+    m_nudges.reserve(max_nudge);
+    m_peaks.reserve(max_nudge);
+    if (m_trigger_engine == TriggerEngine::Transient) {
+        m_onsets.resize(max_nudge);
+    }
+    m_similarities.reserve(max_nudge);
+    m_chunks.reserve(max_nudge);
+    if (m_correlator) {
+        m_distances.resize(max_nudge);
+    } else if (m_coarse_factor > 1) {
+        size_t history_length = max_nudge + std::max(m_similarity_window, 0);
+        size_t phase_length = history_length / m_coarse_factor;
+
+        m_prefix_sums.resize(history_length + 1);
+        m_coarse_floats.resize(phase_length * m_coarse_factor);
+        m_coarse_phase_ready.resize(m_coarse_factor);
+        m_coarse_prev.resize(std::max(m_similarity_window, 0) / m_coarse_factor);
+        m_coarse_scores.resize(max_nudge);
+        m_coarse_ranking.reserve(max_nudge);
+    }
+}
+
 void Scope::next_wave_data() {
-    update_buffers();
+#ifdef OSMIUM_COUNT_ALLOCATIONS
+    uint64_t allocations_before = thread_allocation_count();
+#endif
 
-    std::optional<int32_t> maybe_nudge;
+    (this->*m_frame_kernel)();
+
+#ifdef OSMIUM_COUNT_ALLOCATIONS
+    // Whatever the sample source allocates is its own business
+    m_frame_allocations =
+        thread_allocation_count() - allocations_before - m_source_allocations;
+    assert(m_frame_allocations == 0);
+#endif
+}
+
+uint64_t Scope::get_preroll_frames() const {
+    return div_ceil<uint64_t>(m_left_buffer.size(), m_samples_per_frame)
+           + SEEK_WARMUP_FRAMES;
+}
+
+void Scope::seek(uint64_t frame) {
+    uint64_t start = frame - std::min(frame, get_preroll_frames());
+    m_source->seek(start * m_samples_per_frame);
+
+    // Forget everything, as if the scope had been built at `start`
+    m_left_buffer.clear();
+    m_right_buffer.clear();
     if (m_is_stereo) {
-        maybe_nudge = find_best_nudge(stereo_downmix(m_left_buffer, m_right_buffer),
-                                      stereo_downmix(m_left_output, m_right_output));
+        m_mix_buffer.clear();
+        std::ranges::fill(m_downmix_output, 0.0f);
+    }
+    m_peak_tracker.reset(m_left_buffer.size(), m_samples_per_frame);
+    std::ranges::fill(m_left_output, 0.0f);
+    std::ranges::fill(m_right_output, 0.0f);
+    if (m_note_tracker) {
+        m_note_tracker->rewind();
+    }
+
+    m_total_samples_read = start * m_samples_per_frame * m_src_num_channels;
+    m_nudge_amount = 0;
+    m_nudge_change = 0;
+    m_frame_num = 0;
+    m_frames_processed = start;
+    m_no_good_nudge = false;
+
+    // A track with a jump in it would be useless, unless it's starting over
+    if (m_track_path) {
+        if (frame == 0) {
+            m_recorded_nudges.clear();
+            m_track_complete = false;
+        } else {
+            m_track_path.reset();
+        }
+    }
+
+    for (uint64_t i = start; i < frame; i++) {
+        next_wave_data();
+    }
+}
+
+void Scope::select_kernels() {
+    // Indexed by [stereo display][drift window]
+    static constexpr FrameKernel KERNELS[2][2] = {
+        {&Scope::process_frame<false, false>, &Scope::process_frame<false, true>},
+        {&Scope::process_frame<true, false>, &Scope::process_frame<true, true>},
+    };
+
+    m_frame_kernel = KERNELS[m_is_stereo][m_drift_window > 0];
+}
+
+template<bool Stereo, bool Drift>
+void Scope::process_frame() {
+    update_buffers<Stereo>();
+
+    std::optional<int32_t> maybe_nudge;
+    if (m_trigger_track && m_frames_processed < m_trigger_track->get_num_frames()) {
+        // Ignore anything that would put the view window out of bounds
+        int32_t nudge = m_trigger_track->get_nudge(m_frames_processed);
+        if (nudge >= 0 && nudge <= m_max_nudge) {
+            maybe_nudge = nudge;
+        }
     } else {
-        maybe_nudge = find_best_nudge(m_left_buffer, m_right_buffer);
+        if constexpr (Stereo) {
+            maybe_nudge = find_best_nudge<Drift>(m_mix_buffer.view(), m_downmix_output);
+        } else {
+            maybe_nudge =
+                find_best_nudge<Drift>(m_left_buffer.view(), m_right_buffer.view());
+        }
+    }
+    m_frames_processed++;
+
+    if (m_track_path && !m_track_complete) {
+        record_nudge(maybe_nudge);
     }
 
     m_no_good_nudge = !maybe_nudge.has_value();
@@ -108,149 +244,152 @@ void Scope::next_wave_data() {
     m_nudge_change = nudge - m_nudge_amount;
     m_nudge_amount = nudge;
 
-    for (uint32_t i = 0; i < m_window_size; i++) {
-        m_left_output[i] = m_left_buffer[i + nudge] * m_amplification;
+    // In stereo, also downmix the output for the next frame to compare against
+    if constexpr (Stereo) {
+        scale_stereo(m_left_buffer.data() + nudge,
+                     m_right_buffer.data() + nudge,
+                     m_amplification,
+                     m_window_size,
+                     m_left_output.data(),
+                     m_right_output.data(),
+                     m_downmix_output.data());
+    } else {
+        scale_mono(m_left_buffer.data() + nudge,
+                   m_amplification,
+                   m_window_size,
+                   m_left_output.data());
     }
-    if (m_is_stereo) {
-        for (uint32_t i = 0; i < m_window_size; i++) {
-            m_right_output[i] = m_right_buffer[i + nudge] * m_amplification;
-        }
+}
+
+void Scope::record_nudge(std::optional<int32_t> nudge) {
+    // Growing the buffer would mean allocating mid-render. If the source runs this far
+    // past its reported length, just give up on saving the track.
+    if (m_recorded_nudges.size() == m_recorded_nudges.capacity()) {
+        m_track_path.reset();
+        return;
     }
+
+    m_recorded_nudges.push_back(nudge.value_or(TriggerTrack::NO_NUDGE));
+    m_track_complete = !m_source->is_playing();
 }
 
+void Scope::flush_trigger_track() {
+    if (!m_track_path || !m_track_complete)
+        return;
+
+    TriggerTrack::save(*m_track_path, m_track_key, m_recorded_nudges);
+    m_track_path.reset();
+}
+
+template<bool Stereo>
 void Scope::update_buffers() {
-    std::vector<float> data(static_cast<size_t>(m_samples_per_frame)
-                            * m_src_num_channels);
+    const uint32_t num_channels = m_src_num_channels;
 
     // Read the stream data
-    uint32_t bytes_read =
-        BASS_ChannelGetData(*m_stream_handle,
-                            data.data(),
-                            (data.size() * sizeof(float)) | BASS_DATA_FLOAT);
-    if (bytes_read == -1) {
-        int code = BASS_ErrorGetCode();
-        if (code != BASS_ERROR_ENDED)
-            throw Error::from_bass_error("Error getting wave data: ");
+#ifdef OSMIUM_COUNT_ALLOCATIONS
+    uint64_t allocations_before = thread_allocation_count();
+#endif
+    uint32_t samples_read = m_source->read(m_read_buffer.data(), m_samples_per_frame);
+#ifdef OSMIUM_COUNT_ALLOCATIONS
+    m_source_allocations = thread_allocation_count() - allocations_before;
+#endif
 
+    if (samples_read == 0) {
         // At the end of the data; shift in zeroes and exit early
         shift_in(m_left_buffer, {}, m_samples_per_frame);
         shift_in(m_right_buffer, {}, m_samples_per_frame);
+        if constexpr (Stereo) {
+            shift_in(m_mix_buffer, {}, m_samples_per_frame);
+        }
+        m_peak_tracker.push_block(0.0f);
         return;
     }
 
     m_frame_num++;
-    uint32_t samples_read = bytes_read / sizeof(float) / m_src_num_channels;
-    m_total_samples_read += static_cast<uint64_t>(samples_read) * m_src_num_channels;
-
-    // Demux the data into left and right channels
-    std::vector<float> new_left_samples(samples_read);
-    std::vector<float> new_right_samples(samples_read);
-
-    if (m_is_stereo) {
-        if (m_src_num_channels == 1) {
-            std::copy(data.cbegin(),
-                      data.cbegin() + samples_read,
-                      new_left_samples.begin());
-        } else {
-            // TODO: Maybe try downmixing 5.1/7.1 to stereo? Probably overkill tbh.
-            for (uint32_t i = 0; i < samples_read; i++) {
-                uint32_t j = i * m_src_num_channels;
-                new_left_samples[i] = data[j];
-                new_right_samples[i] = data[j + 1];
-            }
-        }
+    m_total_samples_read += static_cast<uint64_t>(samples_read) * num_channels;
+
+    // Demux the data into left and right channels (or downmix it to mono), noting the
+    // peak of the signal the trigger will look at along the way
+    std::span<float> new_left_samples(m_new_left_samples.data(), samples_read);
+    std::span<float> new_right_samples(m_new_right_samples.data(), samples_read);
+    std::span<float> new_mix_samples(m_new_mix_samples.data(),
+                                     Stereo ? samples_read : 0);
+
+    float peak;
+    if constexpr (Stereo) {
+        peak = deinterleave_stereo(m_read_buffer.data(),
+                                   num_channels,
+                                   samples_read,
+                                   new_left_samples.data(),
+                                   new_right_samples.data(),
+                                   new_mix_samples.data());
     } else {
-        if (m_src_num_channels == 1) {
-            std::copy(data.cbegin(),
-                      data.cbegin() + samples_read,
-                      new_left_samples.begin());
-        } else {
-            for (uint32_t i = 0; i < samples_read; i++) {
-                uint32_t j = i * m_src_num_channels;
-                new_left_samples[i] = (data[j] + data[j + 1]) * 0.5;
-            }
-        }
+        peak = downmix_to_mono(m_read_buffer.data(),
+                               num_channels,
+                               samples_read,
+                               new_left_samples.data());
     }
 
+    // Short reads get padded with zeros
+    if (samples_read < static_cast<uint32_t>(m_samples_per_frame)) {
+        peak = std::max(peak, 0.0f);
+    }
+    m_peak_tracker.push_block(peak);
+
     // Shift the samples into their respective buffers.
     shift_in(m_left_buffer, new_left_samples, m_samples_per_frame);
-    if (m_is_stereo) {
+    if constexpr (Stereo) {
         shift_in(m_right_buffer, new_right_samples, m_samples_per_frame);
+        shift_in(m_mix_buffer, new_mix_samples, m_samples_per_frame);
     }
 }
 
-struct nudge_data {
-    int32_t amount;
-    int32_t dist_from_zero = 0;
-    bool is_before_peak = false;
-};
-
-std::optional<int32_t> Scope::find_best_nudge(const std::vector<float>& floats,
-                                              const std::vector<float>& prev) {
+template<bool Drift>
+std::optional<int32_t> Scope::find_best_nudge(std::span<const float> floats,
+                                              std::span<const float> prev) {
     const double EPSILON = 0.005;
 
+    if (m_trigger_engine == TriggerEngine::Transient)
+        return find_transient(floats);
+
     // floats.size() == m_window_size + m_max_nudge;
     uint32_t view_window_midpoint = m_window_size / 2;
 
     // double peak_amplitude = *abs_max_element(floats.cbegin(), floats.cend());
-    double peak_amplitude = *std::max_element(floats.cbegin(), floats.cend());
+    double peak_amplitude = m_peak_tracker.peak(floats);
     double peak_amp_threshold = peak_amplitude * m_peak_bias_min_factor;
     double trigger_threshold = std::max(EPSILON, m_trigger_threshold * peak_amplitude);
 
     // Find all rising edges within the window
-    std::vector<nudge_data> base_nudges;
-    std::queue<int32_t> peaks;
-    int32_t last_candidate_nudge = 0;
-    float last_amplitude = 0;
-
-    bool lower_bound_cross = false;
-    bool upper_bound_cross = false;
-
-    for (int32_t offs = 0; offs < m_max_nudge; offs++) {
-        float f = floats[view_window_midpoint + offs];
-
-        if (f < -trigger_threshold) {
-            lower_bound_cross = false;
-        } else if (last_amplitude < -trigger_threshold) {
-            lower_bound_cross = true;
-        }
-
-        if (f < trigger_threshold) {
-            upper_bound_cross = false;
-        } else if (last_amplitude < trigger_threshold) {
-            upper_bound_cross = true;
-        }
-
-        if (last_amplitude < EPSILON && f >= EPSILON) {
-            last_candidate_nudge = offs;
-        }
-
-        if (lower_bound_cross && upper_bound_cross) {
-            base_nudges.emplace_back(last_candidate_nudge);
-            lower_bound_cross = false;
-            upper_bound_cross = false;
-        }
-
-        if (f > peak_amp_threshold && !base_nudges.empty()
-            && !base_nudges.back().is_before_peak) {
-            peaks.push(offs);
-            base_nudges.back().is_before_peak = true;
-        }
-
-        last_amplitude = f;
-    }
+    find_rising_edges(floats.subspan(view_window_midpoint, m_max_nudge),
+                      trigger_threshold,
+                      EPSILON,
+                      peak_amp_threshold);
+    std::vector<nudge_data>& base_nudges = m_base_nudges;
+    std::vector<int32_t>& peaks = m_peaks;
 
     // Early exits if no candidate nudges were found
     if (base_nudges.empty())
         return std::nullopt;
 
+    // Noisy signals can have hundreds of rising edges. Keep few enough of them that even
+    // after adding the drift window around each one, the candidates fit in the budget.
+    if (m_max_candidates > 0) {
+        auto candidates_per_edge = static_cast<size_t>(std::max(m_drift_window, 1));
+        size_t max_edges = std::max<size_t>(m_max_candidates / candidates_per_edge, 1);
+        if (base_nudges.size() > max_edges) {
+            subsample_edges(max_edges);
+        }
+    }
+
     // Add extra nudges in a window around the centers
-    std::vector<nudge_data> nudges;
-    if (m_drift_window == 0) {
-        nudges = base_nudges;
+    std::vector<nudge_data>& nudges = m_nudges;
+    if constexpr (!Drift) {
+        nudges.assign(base_nudges.cbegin(), base_nudges.cend());
     } else {
-        nudges.reserve(std::max(m_drift_window, 1) * base_nudges.size());
+        nudges.clear();
 
+        size_t next_peak = 0;
         int32_t min_start = 0;
         for (int32_t i = 0; i < base_nudges.size(); i++) {
             const auto& base_nudge = base_nudges[i];
@@ -267,66 +406,557 @@ std::optional<int32_t> Scope::find_best_nudge(const std::vector<float>& floats,
                 {base_nudge.amount + div_ceil(m_drift_window, 2), m_max_nudge, halfway});
 
             for (int32_t j = start; j < end; j++) {
-                bool is_before_peak = base_nudge.is_before_peak && j <= peaks.front();
+                bool is_before_peak = base_nudge.is_before_peak && j <= peaks[next_peak];
                 nudges.emplace_back(j, j - base_nudge.amount, is_before_peak);
             }
 
             if (base_nudge.is_before_peak) {
-                peaks.pop();
+                next_peak++;
             }
 
             min_start = end;
         }
     }
 
+    // If the notes being played are known, only look at candidates that line up with
+    // the previous frame
+    m_frame_similarity_window = m_similarity_window;
+    if (auto period = expected_period()) {
+        restrict_to_period(*period);
+    }
+
+    // A negative similarity bias would make the error bounds meaningless
+    if (!m_correlator && m_coarse_factor <= 1 && m_similarity_bias >= 0)
+        return bounded_search<Drift>(floats, prev);
+
     // Compute an error value for each candidate nudge. This is based on
     // multiple factors that can be weighted individually by the user.
     uint32_t sim_window_start = (m_window_size - m_similarity_window) / 2;
     int32_t best_nudge = 0;
     double min_error = std::numeric_limits<double>::infinity();
 
-    for (const auto& nudge : nudges) {
-        bool flag2 = false;
-
-        // Factor 1: Compute the average difference between a candidate view
-        // window and the previous one. (Should typically range between 0 and 2)
-        double similarity_factor = 0;
-        for (uint32_t i = 0; i < m_similarity_window; i++) {
-            similarity_factor += std::abs(floats[nudge.amount + i + sim_window_start]
-                                          - prev[i + sim_window_start]);
+    std::vector<double>& similarities = m_similarities;
+    similarities.resize(nudges.size());
+    if (m_correlator && m_frame_similarity_window == m_similarity_window) {
+        // Score every offset in [0, m_max_nudge) in one go, then pick out the candidates.
+        // (The correlator's window is fixed, so frames whose window was fitted to the
+        // note's period are scored exactly below instead.)
+        std::vector<double>& distances = m_distances;
+        m_correlator->sum_squared_diffs(floats.data() + sim_window_start,
+                                        prev.data() + sim_window_start,
+                                        distances.data());
+
+        for (size_t n = 0; n < nudges.size(); n++) {
+            double mean_square = distances[nudges[n].amount] / m_similarity_window;
+            similarities[n] = std::sqrt(std::max(mean_square, 0.0));
         }
-        similarity_factor /= m_similarity_window;
-
-        // Factor 2: If a nudge is before a peak value, reduce its error. This
-        // prioritizes output windows centered before large amplitudes.
-        double before_peak_factor = nudge.is_before_peak ? 0 : 1;
-
-        // Factor 3: Penalize a nudge if it's far away from a zero
-        double drift_factor =
-            m_drift_window == 0
-                ? 0
-                : std::abs(static_cast<double>(nudge.dist_from_zero) / m_drift_window);
+    } else if (!m_correlator && m_coarse_factor > 1
+               && m_frame_similarity_window / m_coarse_factor > 0) {
+        coarse_to_fine_similarities<Drift>(floats, prev);
+    } else {
+        exact_similarities(floats, prev, 0, nudges.size());
+    }
 
-        double error = similarity_factor * m_similarity_bias
-                       + before_peak_factor * m_peak_bias
-                       + drift_factor * m_avoid_drift_bias;
+    for (size_t n = 0; n < nudges.size(); n++) {
+        // Candidates ruled out by the coarse search were never scored
+        if (std::isinf(similarities[n]))
+            continue;
 
         // If we've found a nudge with lower error, use it
+        double error = nudge_error<Drift>(nudges[n], similarities[n]);
         if (error < min_error) {
             min_error = error;
-            best_nudge = nudge.amount;
+            best_nudge = nudges[n].amount;
         }
     }
 
     return best_nudge;
 }
 
+std::optional<double> Scope::expected_period() {
+    if (!m_note_tracker)
+        return std::nullopt;
+
+    // Follow the notes up to the middle of the range the trigger searches
+    auto frames_read = static_cast<double>(m_total_samples_read / m_src_num_channels);
+    double search_midpoint = frames_read - static_cast<double>(m_left_buffer.size())
+                             + m_window_size / 2 + m_max_nudge / 2.0;
+    m_note_tracker->advance_to(std::max(search_midpoint, 0.0) / m_sample_rate);
+
+    auto frequency = m_note_tracker->get_lowest_frequency();
+    if (!frequency)
+        return std::nullopt;
+    return m_sample_rate / *frequency;
+}
+
+void Scope::restrict_to_period(double period) {
+    // Compare a whole number of periods, so it doesn't matter which part of the cycle the
+    // similarity window starts and ends in
+    if (period <= m_similarity_window) {
+        double num_periods = std::floor(m_similarity_window / period);
+        m_frame_similarity_window =
+            std::max(static_cast<int32_t>(std::lround(num_periods * period)), 1);
+    }
+
+    if (m_frame_num <= 1 || m_no_good_nudge)
+        return;
+
+    // Since the last frame, the waveform has moved back by a frame's worth of samples.
+    // Nudging by that much less, give or take whole periods, keeps it in phase.
+    double anchor = m_nudge_amount - m_samples_per_frame;
+    double tolerance = std::max(PERIOD_TOLERANCE * period, MIN_PERIOD_TOLERANCE);
+    auto out_of_phase = [&](const nudge_data& nudge) {
+        double phase = std::fmod(nudge.amount - anchor, period);
+        if (phase < 0) {
+            phase += period;
+        }
+        return std::min(phase, period - phase) > tolerance;
+    };
+
+    // If nothing lines up (e.g. because a new note just started), keep every candidate
+    if (std::ranges::all_of(m_nudges, out_of_phase))
+        return;
+    std::erase_if(m_nudges, out_of_phase);
+}
+
+template<bool Drift>
+double Scope::nudge_error(const nudge_data& nudge, double similarity_factor) const {
+    // Factor 1: The average difference between a candidate view window and the previous
+    // one. (Should typically range between 0 and 2)
+
+    // Factor 2: If a nudge is before a peak value, reduce its error. This
+    // prioritizes output windows centered before large amplitudes.
+    double before_peak_factor = nudge.is_before_peak ? 0 : 1;
+
+    // Factor 3: Penalize a nudge if it's far away from a zero
+    double drift_factor = 0;
+    if constexpr (Drift) {
+        drift_factor =
+            std::abs(static_cast<double>(nudge.dist_from_zero) / m_drift_window);
+    }
+
+    return similarity_factor * m_similarity_bias + before_peak_factor * m_peak_bias
+           + drift_factor * m_avoid_drift_bias;
+}
+
+void Scope::find_rising_edges(std::span<const float> samples,
+                              double trigger_threshold,
+                              double epsilon,
+                              double peak_amp_threshold) {
+    // Bits per block: one for each sample
+    constexpr int32_t BLOCK_SIZE = 64;
+
+    m_base_nudges.clear();
+    m_peaks.clear();
+
+    // A rising edge starts at the last upward crossing of (almost) zero before the signal
+    // rises through -threshold and then +threshold, with no rising edge in between. The
+    // first sample after an edge that's above the peak threshold is its peak.
+    //
+    // All the per-sample work is done as whole-vector comparisons. What's left is a walk
+    // over the (few) crossings, in order, jumping straight from one to the next.
+    ThresholdComparator comparator(
+        trigger_threshold, -trigger_threshold, epsilon, peak_amp_threshold);
+
+    // State carried over between blocks. The sample before the first one counts as 0.
+    bool last_below_upper = true;
+    bool last_below_lower = false;
+    bool last_below_zero = true;
+    bool lower_bound_cross = false;
+    bool awaiting_peak = false;
+    int32_t last_candidate_nudge = 0;
+
+    auto num_samples = static_cast<int32_t>(samples.size());
+    for (int32_t block_start = 0; block_start < num_samples; block_start += BLOCK_SIZE) {
+        auto count =
+            static_cast<uint32_t>(std::min(num_samples - block_start, BLOCK_SIZE));
+        ThresholdMasks masks = comparator.compare(samples.data() + block_start, count);
+        uint64_t valid = count == BLOCK_SIZE ? ~uint64_t{0} : (uint64_t{1} << count) - 1;
+
+        // A sample crosses a threshold if it isn't below it, but the one before it was
+        auto crossings = [&](uint64_t below, bool& last_below) {
+            uint64_t below_before = (below << 1) | static_cast<uint64_t>(last_below);
+            last_below = (below >> (count - 1)) & 1;
+            return below_before & ~below & valid;
+        };
+        uint64_t upper_crosses = crossings(masks.below_upper, last_below_upper);
+        uint64_t lower_crosses = crossings(masks.below_lower, last_below_lower);
+        uint64_t zero_crosses = ((masks.below_zero << 1) | uint64_t{last_below_zero})
+                                & masks.reached_zero;
+        last_below_zero = (masks.below_zero >> (count - 1)) & 1;
+
+        // Crossings of the lower threshold arm the trigger; crossings of the upper one
+        // fire it. Peaks only matter while the newest edge doesn't have one yet.
+        uint64_t pending = valid;
+        while (true) {
+            uint64_t events = (lower_crosses | upper_crosses
+                               | (awaiting_peak ? masks.above_peak : 0))
+                              & pending;
+            if (events == 0)
+                break;
+
+            int bit = std::countr_zero(events);
+            uint64_t here = uint64_t{1} << bit;
+            uint64_t up_to_here = here | (here - 1);
+            pending &= ~up_to_here;
+
+            if (lower_crosses & here) {
+                lower_bound_cross = true;
+            }
+
+            if ((upper_crosses & here) && lower_bound_cross) {
+                if (uint64_t zeros = zero_crosses & up_to_here) {
+                    last_candidate_nudge = block_start + 63 - std::countl_zero(zeros);
+                }
+                m_base_nudges.emplace_back(last_candidate_nudge);
+                lower_bound_cross = false;
+                awaiting_peak = true;
+            }
+
+            if ((masks.above_peak & here) && awaiting_peak) {
+                m_peaks.push_back(block_start + bit);
+                m_base_nudges.back().is_before_peak = true;
+                awaiting_peak = false;
+            }
+        }
+
+        if (zero_crosses != 0) {
+            last_candidate_nudge = block_start + 63 - std::countl_zero(zero_crosses);
+        }
+    }
+}
+
+void Scope::subsample_edges(size_t count) {
+    std::vector<nudge_data>& base_nudges = m_base_nudges;
+    size_t num_edges = base_nudges.size();
+
+    // Where the last frame's trigger point is now. Staying close to it keeps the picture
+    // steady, so it's worth keeping the edge nearest to it.
+    std::optional<int32_t> anchor;
+    if (m_frame_num > 1 && !m_no_good_nudge) {
+        anchor = m_nudge_amount - m_samples_per_frame;
+    }
+    auto is_better = [&](const nudge_data& a, const nudge_data& b) {
+        if (a.is_before_peak != b.is_before_peak)
+            return a.is_before_peak;
+        return anchor && std::abs(a.amount - *anchor) < std::abs(b.amount - *anchor);
+    };
+
+    // Split the edges into `count` equal buckets and keep the best edge of each. Kept
+    // edges are moved to the front, which never overwrites one that's yet to be read.
+    size_t num_kept = 0;
+    size_t num_peaks_kept = 0;
+    size_t i = 0;
+    size_t peak = 0; // Index into m_peaks of the next edge before a peak
+    for (size_t k = 0; k < count; k++) {
+        size_t end = (k + 1) * num_edges / count;
+        size_t best = i;
+        size_t best_peak = peak;
+        for (; i < end; i++) {
+            if (is_better(base_nudges[i], base_nudges[best])) {
+                best = i;
+                best_peak = peak;
+            }
+            if (base_nudges[i].is_before_peak) {
+                peak++;
+            }
+        }
+
+        if (base_nudges[best].is_before_peak) {
+            m_peaks[num_peaks_kept++] = m_peaks[best_peak];
+        }
+        base_nudges[num_kept++] = base_nudges[best];
+    }
+
+    base_nudges.resize(num_kept);
+    m_peaks.resize(num_peaks_kept);
+}
+
+std::optional<int32_t> Scope::find_transient(std::span<const float> floats) {
+    const float EPSILON = 0.005f;
+
+    // Onset strength is how far a fast envelope follower has risen above (a multiple of)
+    // a slow one.
+    // Both follow the rectified signal from the start of the buffer, so they have settled
+    // by the time they reach the search range.
+    auto coefficient = [&](double seconds) {
+        return static_cast<float>(1 - std::exp(-1 / (seconds * m_sample_rate)));
+    };
+    float fast_coefficient = coefficient(FAST_ENVELOPE_SECONDS);
+    float slow_coefficient = coefficient(SLOW_ENVELOPE_SECONDS);
+
+    uint32_t view_window_midpoint = m_window_size / 2;
+    float level = 0;
+    for (uint32_t i = 0; i < view_window_midpoint; i++) {
+        level += std::abs(floats[i]);
+    }
+    float fast = view_window_midpoint > 0 ? level / view_window_midpoint : 0;
+    float slow = fast;
+
+    float max_onset = 0;
+    for (uint32_t i = 0; i < view_window_midpoint + m_max_nudge; i++) {
+        float magnitude = std::abs(floats[i]);
+        fast += (magnitude - fast) * fast_coefficient;
+        slow += (magnitude - slow) * slow_coefficient;
+
+        if (i >= view_window_midpoint) {
+            float onset = std::max(fast - slow * MIN_ONSET_RATIO, 0.0f);
+            m_onsets[i - view_window_midpoint] = onset;
+            max_onset = std::max(max_onset, onset);
+        }
+    }
+
+    // Silence, or a sound that's holding steady
+    if (max_onset < EPSILON)
+        return std::nullopt;
+
+    // Trigger on the first onset at least half as strong as the strongest one. Back up to
+    // where it started rising, since where it peaks depends on how long the attack is.
+    float threshold = max_onset * ONSET_THRESHOLD;
+    for (int32_t offs = 0; offs < m_max_nudge; offs++) {
+        if (m_onsets[offs] >= threshold) {
+            while (offs > 0 && m_onsets[offs - 1] > EPSILON
+                   && m_onsets[offs - 1] < m_onsets[offs]) {
+                offs--;
+            }
+            return offs;
+        }
+    }
+
+    return std::nullopt;
+}
+
+void Scope::exact_similarities(std::span<const float> floats,
+                               std::span<const float> prev,
+                               size_t begin,
+                               size_t end) {
+    uint32_t sim_window_start = (m_window_size - m_frame_similarity_window) / 2;
+
+    // Candidate nudges come in runs of consecutive amounts (one per drift window), which
+    // lets the similarity sums for a whole run be computed by a single vectorized call.
+    for (size_t run_start = begin; run_start < end;) {
+        size_t run_end = run_start + 1;
+        while (run_end < end
+               && m_nudges[run_end].amount == m_nudges[run_end - 1].amount + 1) {
+            run_end++;
+        }
+
+        sum_abs_diffs(floats.data() + sim_window_start + m_nudges[run_start].amount,
+                      prev.data() + sim_window_start,
+                      m_frame_similarity_window,
+                      static_cast<uint32_t>(run_end - run_start),
+                      m_similarities.data() + run_start);
+        run_start = run_end;
+    }
+
+    for (size_t n = begin; n < end; n++) {
+        m_similarities[n] /= m_frame_similarity_window;
+    }
+}
+
+template<bool Drift>
+int32_t Scope::bounded_search(std::span<const float> floats,
+                              std::span<const float> prev) {
+    // Number of samples to accumulate between checks against the current best error
+    constexpr uint32_t BLOCK_SIZE = 256;
+    // Widest SIMD kernel (AVX-512) processes 32 offsets at a time
+    constexpr size_t MAX_CHUNK_SIZE = 32;
+
+    const std::vector<nudge_data>& nudges = m_nudges;
+    uint32_t sim_window_start = (m_window_size - m_frame_similarity_window) / 2;
+    const float* sim_floats = floats.data() + sim_window_start;
+    const float* sim_prev = prev.data() + sim_window_start;
+    m_similarities.resize(nudges.size());
+
+    // The similarity term can't be negative, so a candidate's error is never below its
+    // error with a perfect similarity score. Split runs of consecutive candidates into
+    // SIMD-sized chunks, and bound each chunk by its best such score.
+    m_chunks.clear();
+    for (size_t begin = 0; begin < nudges.size();) {
+        size_t end = begin + 1;
+        while (end < nudges.size() && end - begin < MAX_CHUNK_SIZE
+               && nudges[end].amount == nudges[end - 1].amount + 1) {
+            end++;
+        }
+
+        double bound = std::numeric_limits<double>::infinity();
+        for (size_t n = begin; n < end; n++) {
+            bound = std::min(bound, nudge_error<Drift>(nudges[n], 0));
+        }
+        m_chunks.push_back({begin, end, bound});
+        begin = end;
+    }
+
+    // Visit the most promising chunks first, so that a good best error is found early
+    std::sort(m_chunks.begin(), m_chunks.end(), [](const auto& a, const auto& b) {
+        return a.bound < b.bound || (a.bound == b.bound && a.begin < b.begin);
+    });
+
+    // Ties go to the earliest candidate, as with an exhaustive search
+    double min_error = std::numeric_limits<double>::infinity();
+    size_t best = nudges.size();
+    auto can_beat_best = [&](double error, size_t n) {
+        return error < min_error || (error == min_error && n < best);
+    };
+
+    for (const auto& chunk : m_chunks) {
+        // Every remaining chunk is bounded at least as badly. (A chunk bounded exactly at
+        // the best error can still win a tie if it comes earlier.)
+        if (chunk.bound > min_error)
+            break;
+        if (!can_beat_best(chunk.bound, chunk.begin))
+            continue;
+
+        size_t begin = chunk.begin;
+        size_t end = chunk.end;
+        std::fill(m_similarities.begin() + begin, m_similarities.begin() + end, 0.0);
+
+        // Accumulate block by block, dropping candidates from either end of the chunk
+        // once their partial error can no longer beat the best one
+        uint32_t length = m_frame_similarity_window;
+        for (uint32_t i = 0; i < length && begin < end; i += BLOCK_SIZE) {
+            uint32_t block = std::min(BLOCK_SIZE, length - i);
+            accumulate_abs_diffs(sim_floats + nudges[begin].amount + i,
+                                 sim_prev + i,
+                                 block,
+                                 static_cast<uint32_t>(end - begin),
+                                 m_similarities.data() + begin);
+
+            auto is_hopeless = [&](size_t n) {
+                double partial = m_similarities[n] / m_frame_similarity_window;
+                return !can_beat_best(nudge_error<Drift>(nudges[n], partial), n);
+            };
+            while (begin < end && is_hopeless(begin)) {
+                begin++;
+            }
+            while (begin < end && is_hopeless(end - 1)) {
+                end--;
+            }
+        }
+
+        for (size_t n = begin; n < end; n++) {
+            double similarity = m_similarities[n] / m_frame_similarity_window;
+            double error = nudge_error<Drift>(nudges[n], similarity);
+            if (can_beat_best(error, n)) {
+                min_error = error;
+                best = n;
+            }
+        }
+    }
+
+    // Nothing scored (every error was NaN); fall back to no nudge, as the exhaustive
+    // search does
+    if (best == nudges.size())
+        return 0;
+    return nudges[best].amount;
+}
+
+template<bool Drift>
+void Scope::coarse_to_fine_similarities(std::span<const float> floats,
+                                        std::span<const float> prev) {
+    const std::vector<nudge_data>& nudges = m_nudges;
+    uint32_t sim_window_start = (m_window_size - m_frame_similarity_window) / 2;
+    int32_t factor = m_coarse_factor;
+    int32_t coarse_window = m_frame_similarity_window / factor;
+
+    // Decimate by averaging blocks of `factor` samples. A candidate at nudge amount `a`
+    // lines up with the decimation that starts at phase `a % factor`, so each phase gets
+    // its own decimated copy, built the first time a candidate needs it. A prefix sum of
+    // `floats` makes every block average constant-time.
+    // Candidates reach at most this far past the start of the similarity window, which
+    // can be narrower than the one the scratch buffers were sized for
+    size_t history_length = std::max(m_max_nudge, 0) + m_frame_similarity_window;
+    auto sim_floats = floats.subspan(sim_window_start);
+    m_prefix_sums[0] = 0;
+    for (size_t i = 0; i < history_length; i++) {
+        m_prefix_sums[i + 1] = m_prefix_sums[i] + sim_floats[i];
+    }
+
+    size_t phase_length = m_coarse_floats.size() / factor;
+    std::fill(m_coarse_phase_ready.begin(), m_coarse_phase_ready.end(), false);
+    auto decimated_phase = [&](int32_t phase) {
+        float* decimated = m_coarse_floats.data() + phase * phase_length;
+        if (!m_coarse_phase_ready[phase]) {
+            // Only whole blocks fit, so later phases may have one sample fewer
+            size_t length = (history_length - phase) / factor;
+            for (size_t j = 0; j < length; j++) {
+                const double* block = m_prefix_sums.data() + phase + j * factor;
+                decimated[j] = static_cast<float>((block[factor] - block[0]) / factor);
+            }
+            m_coarse_phase_ready[phase] = true;
+        }
+        return decimated;
+    };
+
+    for (int32_t i = 0; i < coarse_window; i++) {
+        double sum = 0;
+        for (int32_t j = 0; j < factor; j++) {
+            sum += prev[sim_window_start + i * factor + j];
+        }
+        m_coarse_prev[i] = static_cast<float>(sum / factor);
+    }
+
+    // Coarse pass: within each run of consecutive candidates, score every `factor`th one
+    // against the decimated signals, and keep the best few
+    m_coarse_ranking.clear();
+    for (size_t run_start = 0; run_start < nudges.size();) {
+        size_t run_end = run_start + 1;
+        while (run_end < nudges.size()
+               && nudges[run_end].amount == nudges[run_end - 1].amount + 1) {
+            run_end++;
+        }
+
+        int32_t amount = nudges[run_start].amount;
+        auto num_scored =
+            static_cast<uint32_t>(div_ceil<size_t>(run_end - run_start, factor));
+        sum_abs_diffs(decimated_phase(amount % factor) + amount / factor,
+                      m_coarse_prev.data(),
+                      coarse_window,
+                      num_scored,
+                      m_coarse_scores.data());
+
+        for (uint32_t k = 0; k < num_scored; k++) {
+            size_t n = run_start + static_cast<size_t>(k) * factor;
+            double similarity = m_coarse_scores[k] / coarse_window;
+            double error = nudge_error<Drift>(nudges[n], similarity);
+            m_coarse_ranking.emplace_back(error, n);
+        }
+
+        std::fill(m_similarities.begin() + run_start,
+                  m_similarities.begin() + run_end,
+                  std::numeric_limits<double>::infinity());
+        run_start = run_end;
+    }
+
+    size_t num_survivors = std::min<size_t>(m_coarse_keep, m_coarse_ranking.size());
+    std::partial_sort(m_coarse_ranking.begin(),
+                      m_coarse_ranking.begin() + num_survivors,
+                      m_coarse_ranking.end());
+
+    // Fine pass: score everything within `factor` samples of a survivor at full rate
+    for (size_t k = 0; k < num_survivors; k++) {
+        size_t n = m_coarse_ranking[k].second;
+        int32_t amount = nudges[n].amount;
+
+        size_t begin = n;
+        while (begin > 0 && amount - nudges[begin - 1].amount < factor) {
+            begin--;
+        }
+        size_t end = n + 1;
+        while (end < nudges.size() && nudges[end].amount - amount < factor) {
+            end++;
+        }
+
+        exact_similarities(floats, prev, begin, end);
+    }
+}
+
 uint64_t Scope::get_total_samples() const {
-    return BASS_ChannelGetLength(*m_stream_handle, BASS_POS_BYTE) / sizeof(float);
+    return m_source->get_total_samples();
 }
 
 bool Scope::is_playing() const {
-    return BASS_ChannelIsActive(*m_stream_handle) == BASS_ACTIVE_PLAYING;
+    return m_source->is_playing();
 }
 
 } // namespace osmium
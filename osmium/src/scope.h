@@ -2,13 +2,38 @@
 #define SCOPE_H
 
 #include <cstdint>
+#include <filesystem>
+#include <memory>
 #include <optional>
+#include <span>
+#include <utility>
 #include <vector>
 
-#include "handlewrapper.h"
+#include "conditioning.h"
+#include "notetracker.h"
+#include "samplehistory.h"
+#include "samplesource.h"
+#include "similarity.h"
+#include "triggertrack.h"
 
 namespace osmium {
 
+/** How a scope measures the similarity between a candidate view window and the previous
+ *  frame's output.
+ */
+enum class TriggerEngine {
+    // Mean absolute difference, computed separately for each candidate nudge. Exact, but
+    // costs O(candidates * similarity window).
+    Search,
+    // RMS difference, computed for every possible nudge at once with FFT
+    // cross-correlation. Costs O(N log N) regardless of how many candidates there are.
+    Correlation,
+    // Ignores the shape of the waveform and triggers on the strongest onset in its
+    // amplitude envelope instead. Suits drums and other unpitched sounds, which have no
+    // stable shape to line up. Costs O(window size + max nudge).
+    Transient,
+};
+
 class Scope {
 public:
     const std::vector<float>& get_left_samples() const { return m_left_output; }
@@ -20,14 +45,36 @@ public:
     double get_max_nudge_ms() const { return 1000.0 * m_max_nudge / m_sample_rate; }
     double get_this_nudge_ms() const { return 1000.0 * m_nudge_amount / m_sample_rate; }
     bool get_no_nudges_found() const { return m_no_good_nudge; }
+    /** Whether the nudges come from a trigger track saved by an earlier render. */
+    bool is_replaying_trigger_track() const { return m_trigger_track.has_value(); }
+#ifdef OSMIUM_COUNT_ALLOCATIONS
+    /** Heap allocations made by the last `next_wave_data()` call, excluding any made by
+     *  the sample source. Should always be 0.
+     */
+    uint64_t get_frame_allocations() const { return m_frame_allocations; }
+#endif
 
     uint64_t get_total_samples() const;
     bool is_playing() const;
 
     void next_wave_data();
 
+    /** Jumps to `frame` (counting from 0), so that the next `next_wave_data()` produces
+     *  that frame. The frames just before it are processed first, so the trigger has a
+     *  full history to work with. Throws if the source can't seek.
+     */
+    void seek(uint64_t frame);
+    /** How many frames before its target `seek()` starts reading from. */
+    uint64_t get_preroll_frames() const;
+
+    /** Saves the trigger track recorded while rendering, if the scope has played through
+     *  to the end. Writes to disk, so call it once rendering is done rather than between
+     *  frames.
+     */
+    void flush_trigger_track();
+
 private:
-    HandleWrapper m_stream_handle;
+    std::unique_ptr<SampleSource> m_source;
 
     int32_t m_samples_per_frame;
     uint32_t m_sample_rate;
@@ -45,26 +92,152 @@ private:
     double m_peak_bias_min_factor; // % of peak amplitude to count as pre-peak
     int32_t m_drift_window;        // # samples around a zero-cross to consider
     double m_avoid_drift_bias;     // How much to penalize samples far from a zero-cross
+    int32_t m_coarse_factor;       // Decimation for the coarse search (1 = exhaustive)
+    int32_t m_coarse_keep;         // # coarse candidates to refine at full rate
+    int32_t m_max_candidates;      // Most candidate nudges to score per frame (0 = all)
+    TriggerEngine m_trigger_engine;
+
+    // Only set when using TriggerEngine::Correlation
+    std::unique_ptr<CrossCorrelator> m_correlator;
+    // Only set when tracking the pitch of the channel's notes
+    std::optional<NoteTracker> m_note_tracker;
+    // The similarity window for the current frame, trimmed to a whole number of periods
+    // if the pitch is known
+    int32_t m_frame_similarity_window = 0;
+
+    // Only set when replaying a trigger track saved by an earlier render
+    std::optional<TriggerTrack> m_trigger_track;
+    // Only set when recording a trigger track for later renders
+    std::optional<std::filesystem::path> m_track_path;
+    uint64_t m_track_key = 0;
+    std::vector<int32_t> m_recorded_nudges;
+    bool m_track_complete = false; // Recorded up to the end of the source
 
     // Info/debug variables
     uint64_t m_total_samples_read = 0;
     int32_t m_nudge_amount = 0;
     int32_t m_nudge_change = 0;
     int m_frame_num = 0;
+    uint64_t m_frames_processed = 0; // Including the ones after the source ended
     bool m_no_good_nudge = false;
 
+#ifdef OSMIUM_COUNT_ALLOCATIONS
+    uint64_t m_source_allocations = 0;
+    uint64_t m_frame_allocations = 0;
+#endif
+
     // Buffers
     std::vector<float> m_left_output;
     std::vector<float> m_right_output;
-    std::vector<float> m_left_buffer;
-    std::vector<float> m_right_buffer;
-
-    Scope(uint32_t handle, uint32_t window_size, uint32_t internal_size);
-
+    SampleHistory m_left_buffer;
+    SampleHistory m_right_buffer;
+    SampleHistory m_mix_buffer; // Downmix of the two, only used in stereo
+    BlockPeakTracker m_peak_tracker;
+
+    struct nudge_data {
+        int32_t amount;
+        int32_t dist_from_zero = 0;
+        bool is_before_peak = false;
+    };
+
+    // Per-frame scratch space. Sized once by allocate_scratch() so that next_wave_data()
+    // never has to touch the heap.
+    std::vector<float> m_read_buffer;
+    std::vector<float> m_new_left_samples;
+    std::vector<float> m_new_right_samples;
+    std::vector<float> m_new_mix_samples;
+    std::vector<float> m_downmix_output;
+    std::vector<nudge_data> m_base_nudges;
+    std::vector<nudge_data> m_nudges;
+    std::vector<int32_t> m_peaks;
+    std::vector<float> m_onsets;
+    std::vector<double> m_similarities;
+    struct candidate_chunk {
+        size_t begin;
+        size_t end;
+        double bound;
+    };
+    std::vector<candidate_chunk> m_chunks;
+    std::vector<double> m_distances;
+    std::vector<double> m_prefix_sums;
+    std::vector<float> m_coarse_floats; // One decimated copy per phase
+    std::vector<bool> m_coarse_phase_ready;
+    std::vector<float> m_coarse_prev;
+    std::vector<double> m_coarse_scores;
+    std::vector<std::pair<double, size_t>> m_coarse_ranking;
+
+    Scope(std::unique_ptr<SampleSource> source,
+          uint32_t window_size,
+          uint32_t internal_size);
+
+    // The per-frame work is specialized at compile time for stereo display and whether
+    // there's a drift window, so the hot loops never have to check. ScopeBuilder calls
+    // select_kernels() to pick the version that matches the scope's settings.
+    using FrameKernel = void (Scope::*)();
+    FrameKernel m_frame_kernel = nullptr;
+
+    void allocate_scratch();
+    void select_kernels();
+
+    template<bool Stereo, bool Drift>
+    void process_frame();
+    template<bool Stereo>
     void update_buffers();
-
-    std::optional<int32_t> find_best_nudge(const std::vector<float>&,
-                                           const std::vector<float>&);
+    /** Adds a frame's nudge to the trigger track being recorded. */
+    void record_nudge(std::optional<int32_t> nudge);
+
+    template<bool Drift>
+    std::optional<int32_t> find_best_nudge(std::span<const float> floats,
+                                           std::span<const float> prev);
+    template<bool Drift>
+    double nudge_error(const nudge_data& nudge, double similarity_factor) const;
+
+    /** Fills `m_base_nudges` with the rising edges in `samples` (the search range), and
+     *  `m_peaks` with the first sample above the peak threshold after each edge that has
+     *  one.
+     */
+    void find_rising_edges(std::span<const float> samples,
+                           double trigger_threshold,
+                           double epsilon,
+                           double peak_amp_threshold);
+
+    /** Thins out the rising edges in `m_base_nudges` (and their `m_peaks`) to at most
+     *  `count`, spread evenly over the search range.
+     */
+    void subsample_edges(size_t count);
+
+    /** Finds the nudge that puts the strongest onset in the search range at the middle of
+     *  the view window, if there is one.
+     */
+    std::optional<int32_t> find_transient(std::span<const float> floats);
+
+    /** The period (in samples) of the lowest note currently playing, if known. */
+    std::optional<double> expected_period();
+    /** Drops candidates that don't line up with the previous frame's nudge, and trims the
+     *  similarity window to a whole number of periods.
+     */
+    void restrict_to_period(double period);
+
+    /** Finds the candidate with the lowest error, skipping candidates (and cutting their
+     *  similarity sums short) as soon as they provably can't beat the best one so far.
+     *  Always picks the same candidate as an exhaustive search would.
+     */
+    template<bool Drift>
+    int32_t bounded_search(std::span<const float> floats, std::span<const float> prev);
+
+    /** Fills in `m_similarities[begin:end]` by comparing against every sample. */
+    void exact_similarities(std::span<const float> floats,
+                            std::span<const float> prev,
+                            size_t begin,
+                            size_t end);
+
+    /** Fills in `m_similarities` by first comparing decimated versions of the signals,
+     *  then refining only around the best few candidates at full rate. Candidates that
+     *  weren't refined get a similarity of infinity.
+     */
+    template<bool Drift>
+    void coarse_to_fine_similarities(std::span<const float> floats,
+                                     std::span<const float> prev);
 
     friend class ScopeBuilder;
 };
@@ -7,12 +7,22 @@
 
 #include <algorithm>
 #include <format>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <bass.h>
 #include <bassmidi.h>
 
+#include "decimator.h"
 #include "error.h"
+#include "hashing.h"
+#include "samplesource.h"
+#include "similarity.h"
+#include "soundfont.h"
+#include "stemcache.h"
+#include "triggertrack.h"
 
 namespace osmium {
 
@@ -41,21 +51,6 @@ BOOL CALLBACK midi_filter_track(
     return true;
 }
 
-// -- Helpers --
-
-std::vector<HSOUNDFONT> construct_soundfonts(const std::vector<std::string>& soundfonts) {
-    std::vector<HSOUNDFONT> handles;
-    for (const auto& filename : soundfonts) {
-        HSOUNDFONT handle = BASS_MIDI_FontInit(filename.c_str(), 0);
-        if (!handle)
-            throw Error::from_bass_error("Error initializing soundfont: ");
-
-        handles.push_back(handle);
-    }
-
-    return handles;
-}
-
 } // namespace
 
 // -- ScopeBuilder --
@@ -72,7 +67,14 @@ Scope ScopeBuilder::build_from_file(const char* filename) {
         throw Error::from_bass_error(msg);
     }
 
-    return build_from_handle(handle);
+    std::optional<uint64_t> source_key;
+    if (!m_trigger_cache_dir.empty()) {
+        Hasher hasher;
+        hash_file_contents(hasher, filename);
+        source_key = hasher.digest();
+    }
+
+    return build_from_bass_source(std::make_unique<BassSource>(handle), source_key);
 }
 
 Scope ScopeBuilder::build_from_midi_channel(const char* filename, int channel) {
@@ -81,33 +83,96 @@ Scope ScopeBuilder::build_from_midi_channel(const char* filename, int channel) {
         flags |= BASS_SAMPLE_MONO;
     }
 
-    HSTREAM handle = BASS_MIDI_StreamCreateFile(false, filename, 0, 0, flags, 0);
+    HSTREAM handle =
+        BASS_MIDI_StreamCreateFile(false, filename, 0, 0, flags, m_sample_rate);
     if (!handle)
         throw Error::from_bass_error("Error creating stream: ");
 
-    Scope scope = build_from_handle(handle);
-    scope.m_stream_handle.set_extra_data(channel);
+    auto source = std::make_unique<BassSource>(handle);
+    HandleWrapper& wrapper = source->get_handle();
+    wrapper.set_extra_data(channel);
+    wrapper.set_quality(m_synth_quality);
 
-    int result = BASS_MIDI_StreamSetFilter(handle,
-                                           false,
-                                           midi_filter_channel,
-                                           scope.m_stream_handle.extra_data_ptr().get());
+    int result = BASS_MIDI_StreamSetFilter(
+        handle, false, midi_filter_channel, wrapper.extra_data_ptr().get());
     if (!result)
         throw Error::from_bass_error("Error creating filter: ");
 
-    return scope;
+    std::optional<uint64_t> source_key;
+    if (!m_trigger_cache_dir.empty()) {
+        Hasher hasher;
+        hasher.update(StemCache::source_key(
+            filename, m_soundfonts, source->get_sample_rate(), flags, m_synth_quality));
+        hasher.update(channel);
+        source_key = hasher.digest();
+    }
+
+    return build_from_bass_source(std::move(source), source_key);
+}
+
+std::vector<Scope> ScopeBuilder::build_all_from_midi(const char* filename,
+                                                     const std::vector<int>& channels) {
+    auto synth = std::make_shared<MidiSynth>(
+        filename, m_soundfonts, m_mmap_soundfonts, m_sample_rate, m_synth_quality);
+
+    std::vector<Scope> scopes;
+    scopes.reserve(channels.size());
+    for (int channel : channels) {
+        scopes.push_back(build_from_synth(synth, channel));
+    }
+    return scopes;
 }
 
 Scope ScopeBuilder::build_from_handle(HSTREAM handle) {
-    BASS_CHANNELINFO info;
-    BASS_ChannelGetInfo(handle, &info);
-    if (!BASS_ChannelGetInfo(handle, &info))
-        throw Error::from_bass_error("Error getting channel info: ");
+    return build_from_bass_source(std::make_unique<BassSource>(handle), std::nullopt);
+}
+
+Scope ScopeBuilder::build_from_synth(const std::shared_ptr<MidiSynth>& synth,
+                                     int channel) {
+    std::optional<uint64_t> source_key;
+    if (!m_trigger_cache_dir.empty()) {
+        Hasher hasher;
+        hasher.update(synth->get_source_key());
+        hasher.update(channel);
+        source_key = hasher.digest();
+    }
+
+    // The synth owns the stream and its soundfonts; the scope only reads from it
+    return build(std::make_unique<SynthChannelSource>(synth, channel), source_key);
+}
 
-    if (info.freq > std::numeric_limits<int32_t>::max())
+Scope ScopeBuilder::build_from_source(std::unique_ptr<SampleSource> source) {
+    return build(std::move(source), std::nullopt);
+}
+
+Scope ScopeBuilder::build_from_bass_source(std::unique_ptr<BassSource> source,
+                                           std::optional<uint64_t> source_key) {
+    if (!m_soundfonts.empty()) {
+        source->get_handle().set_soundfonts(
+            load_soundfonts(m_soundfonts, m_mmap_soundfonts));
+    }
+
+    return build(std::move(source), source_key);
+}
+
+Scope ScopeBuilder::build(std::unique_ptr<SampleSource> source,
+                          std::optional<uint64_t> source_key) {
+    if (m_analysis_rate > 0) {
+        uint32_t factor = decimation_factor(source->get_sample_rate(),
+                                            static_cast<uint32_t>(m_frame_rate),
+                                            static_cast<uint32_t>(m_analysis_rate));
+        if (factor > 1)
+            source = std::make_unique<DecimatingSource>(std::move(source), factor);
+    }
+
+    // Everything from here on is at the analysis rate
+    uint32_t freq_hz = source->get_sample_rate();
+    uint32_t num_channels = source->get_num_channels();
+
+    if (freq_hz > std::numeric_limits<int32_t>::max())
         throw Error("Frequency for the internal BASS channel is too high");
 
-    int32_t freq = static_cast<int32_t>(info.freq);
+    int32_t freq = static_cast<int32_t>(freq_hz);
     int32_t samples_per_frame = freq / m_frame_rate;
     // samples/sec * ms/window * sec/ms = samples/window
     int32_t samples_per_window = freq * m_display_window_ms / 1000;
@@ -115,12 +180,20 @@ Scope ScopeBuilder::build_from_handle(HSTREAM handle) {
     int32_t similarity_window = freq * m_similarity_window_ms / 1000;
     int32_t drift_window = freq * (m_drift_window / 1000.0);
 
-    Scope scope(handle, samples_per_window, samples_per_window + max_nudge_samples);
+    if (m_read_ahead_ms > 0) {
+        auto buffer_frames =
+            static_cast<uint32_t>(int64_t{freq} * m_read_ahead_ms / 1000);
+        source = std::make_unique<ReadAheadSource>(
+            std::move(source), buffer_frames, buffer_frames / 2);
+    }
+
+    Scope scope(
+        std::move(source), samples_per_window, samples_per_window + max_nudge_samples);
     scope.m_samples_per_frame = samples_per_frame;
-    scope.m_sample_rate = info.freq;
+    scope.m_sample_rate = freq_hz;
     scope.m_window_size = samples_per_window;
     scope.m_amplification = m_amplification;
-    scope.m_src_num_channels = info.chans;
+    scope.m_src_num_channels = num_channels;
     scope.m_is_stereo = m_stereo;
 
     scope.m_max_nudge = max_nudge_samples;
@@ -131,13 +204,63 @@ Scope ScopeBuilder::build_from_handle(HSTREAM handle) {
     scope.m_peak_bias_min_factor = m_peak_threshold;
     scope.m_drift_window = drift_window;
     scope.m_avoid_drift_bias = m_avoid_drift_bias;
+    scope.m_coarse_factor = std::max(m_coarse_search_factor, 1);
+    scope.m_coarse_keep = std::max(m_coarse_search_keep, 1);
+    scope.m_max_candidates = m_max_candidates;
+    scope.m_trigger_engine = m_trigger_engine;
+    scope.m_note_tracker = m_note_tracker;
 
-    if (!m_soundfonts.empty()) {
-        auto sf_handles = construct_soundfonts(m_soundfonts);
-        scope.m_stream_handle.set_soundfonts(sf_handles);
+    if (m_trigger_engine == TriggerEngine::Correlation && scope.m_similarity_window > 0
+        && max_nudge_samples > 0) {
+        scope.m_correlator = std::make_unique<CrossCorrelator>(
+            scope.m_similarity_window, max_nudge_samples);
+    }
+
+    if (source_key && !m_trigger_cache_dir.empty()) {
+        uint64_t key = trigger_key(*source_key, freq_hz, num_channels);
+        auto path = TriggerTrack::path_in(m_trigger_cache_dir, key);
+        scope.m_trigger_track = TriggerTrack::load(path, key);
+        if (!scope.m_trigger_track) {
+            scope.m_track_path = path;
+            scope.m_track_key = key;
+        }
     }
 
+    scope.allocate_scratch();
+    scope.select_kernels();
+
     return scope;
 }
 
+uint64_t ScopeBuilder::trigger_key(uint64_t source_key,
+                                   uint32_t sample_rate,
+                                   uint32_t num_channels) const {
+    Hasher hasher;
+    hasher.update(source_key);
+    hasher.update(sample_rate);
+    hasher.update(num_channels);
+
+    // Everything that affects which nudges get picked. (The amplification does too,
+    // since each frame is compared against the amplified output of the last one.)
+    hasher.update(m_frame_rate);
+    hasher.update(m_stereo);
+    hasher.update(m_trigger_threshold);
+    hasher.update(m_amplification);
+    hasher.update(m_max_nudge_ms);
+    hasher.update(m_display_window_ms);
+    hasher.update(m_similarity_window_ms);
+    hasher.update(m_similarity_bias);
+    hasher.update(m_peak_threshold);
+    hasher.update(m_peak_bias);
+    hasher.update(m_drift_window);
+    hasher.update(m_avoid_drift_bias);
+    hasher.update(m_trigger_engine);
+    hasher.update(m_coarse_search_factor);
+    hasher.update(m_coarse_search_keep);
+    hasher.update(m_max_candidates);
+    hasher.update(m_note_tracker.has_value());
+
+    return hasher.digest();
+}
+
 } // namespace osmium
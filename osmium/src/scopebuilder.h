@@ -1,10 +1,17 @@
 #ifndef SCOPEBUILDER_H
 #define SCOPEBUILDER_H
 
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include "error.h"
+#include "midisynth.h"
+#include "notetracker.h"
+#include "samplesource.h"
 #include "scope.h"
 
 #define BUILDER_DEF_CHECK(_type, _name, _var_name, _default, _check)                     \
@@ -32,7 +39,13 @@ namespace osmium {
 
 class ScopeBuilder {
     BUILDER_DEF_NONNEG(int, frame_rate, fps, 30)
-    // BUILDER_DEF(unsigned, sample_rate, hz, 48000)
+    // Rate to synthesize MIDI files at. 0 for the rate passed to `osmium::init()`.
+    BUILDER_DEF_NONNEG(int, sample_rate, hz, 0)
+    // Rate to trigger and display the scope at, if lower than the source's. The source is
+    // low-pass filtered and decimated by `decimation_factor()`, so the actual rate is
+    // the nearest one that keeps scope frames lined up with the audio track's, and may
+    // be the full rate. 0 analyzes at the source's rate.
+    BUILDER_DEF_NONNEG(int, analysis_rate, hz, 0)
     BUILDER_DEF(bool, stereo, stereo, true)
     BUILDER_DEF(double, trigger_threshold, threshold, 0.1)
     BUILDER_DEF(double, amplification, amplification, 1.0);
@@ -45,14 +58,57 @@ class ScopeBuilder {
     BUILDER_DEF(double, peak_bias, weight, 0.5)
     BUILDER_DEF_NONNEG(double, drift_window, ms, 0.0)
     BUILDER_DEF(double, avoid_drift_bias, weight, 1.0)
+    BUILDER_DEF(TriggerEngine, trigger_engine, engine, TriggerEngine::Search)
+    // Coarse-to-fine search: compare at 1/factor resolution first, then only refine the
+    // best `count` candidates at full rate. Higher factors and lower counts are faster
+    // but may miss the best nudge. A factor of 1 searches exhaustively.
+    BUILDER_DEF_NONNEG(int, coarse_search_factor, factor, 1)
+    BUILDER_DEF_NONNEG(int, coarse_search_keep, count, 4)
+    // Most candidate nudges to score per frame. Signals with lots of rising edges (noise,
+    // drums) are thinned out evenly to stay within it. 0 means no limit.
+    BUILDER_DEF_NONNEG(int, max_candidates, count, 0)
+    // Restrict candidates using the pitch of the notes playing on the scope's channel
+    BUILDER_DEF(std::optional<NoteTracker>, note_tracker, tracker, std::nullopt)
+
+    // Decode up to this far ahead on a background thread, in blocks of half as much, so
+    // decoding overlaps with triggering and painting instead of holding up every frame.
+    // 0 decodes on the calling thread as each frame needs it.
+    BUILDER_DEF_NONNEG(int, read_ahead_ms, ms, 0)
 
     // NOLINTNEXTLINE(readability-redundant-member-init)
     BUILDER_DEF(std::vector<std::string>, soundfonts, soundfonts, {})
+    BUILDER_DEF(bool, mmap_soundfonts, mmap, false)
+    // NOLINTNEXTLINE(readability-redundant-member-init)
+    BUILDER_DEF(SynthQuality, synth_quality, quality, {})
+
+    // Saves the nudge of every frame under this directory, and replays it in later
+    // renders of the same audio with the same trigger settings instead of searching
+    // again. Only works for scopes built from a file, MIDI channel or synth. Empty to
+    // disable.
+    // NOLINTNEXTLINE(readability-redundant-member-init)
+    BUILDER_DEF(std::filesystem::path, trigger_cache_dir, dir, {})
 
 public:
     Scope build_from_file(const char* filename);
     Scope build_from_midi_channel(const char* filename, int channel);
+    /** Builds a scope for each of `channels`, all reading from one synth, so the file is
+     *  only parsed and synthesized once rather than once per channel.
+     */
+    std::vector<Scope> build_all_from_midi(const char* filename,
+                                           const std::vector<int>& channels);
     Scope build_from_handle(unsigned long handle);
+    Scope build_from_synth(const std::shared_ptr<MidiSynth>& synth, int channel);
+    Scope build_from_source(std::unique_ptr<SampleSource> source);
+
+private:
+    Scope build_from_bass_source(std::unique_ptr<BassSource> source,
+                                 std::optional<uint64_t> source_key);
+    /** `source_key` identifies the audio `source` produces, if it's known. */
+    Scope build(std::unique_ptr<SampleSource> source, std::optional<uint64_t> source_key);
+
+    /** Identifies the trigger points a scope built from the given audio will find. */
+    uint64_t trigger_key(uint64_t source_key, uint32_t sample_rate, uint32_t num_channels)
+        const;
 };
 
 } // namespace osmium
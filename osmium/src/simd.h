@@ -0,0 +1,22 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Shared setup for the hand-vectorized kernels. Not part of the public API.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define OSMIUM_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only let a function use instructions beyond the build's baseline if it's
+// explicitly marked with them. MSVC allows any intrinsic anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define OSMIUM_TARGET(x) __attribute__((target(x)))
+#else
+#define OSMIUM_TARGET(x)
+#endif
+
+#endif // SIMD_H
@@ -0,0 +1,351 @@
+#include "similarity.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <initializer_list>
+
+#include "simd.h"
+
+namespace osmium {
+
+namespace {
+
+void accumulate_abs_diffs_scalar(const float* samples,
+                                 const float* prev,
+                                 uint32_t length,
+                                 uint32_t num_offsets,
+                                 double* out) {
+    for (uint32_t k = 0; k < num_offsets; k++) {
+        double acc = out[k];
+        for (uint32_t i = 0; i < length; i++) {
+            acc += std::abs(samples[k + i] - prev[i]);
+        }
+        out[k] = acc;
+    }
+}
+
+#ifdef OSMIUM_X86
+
+// Each kernel handles a fixed-width block of consecutive offsets per pass over `prev`,
+// using four independent accumulators to hide the latency of the double-precision adds.
+// Whatever's left over is handed to the next narrower kernel.
+
+uint32_t accumulate_abs_diffs_sse2(const float* samples,
+                                   const float* prev,
+                                   uint32_t length,
+                                   uint32_t num_offsets,
+                                   double* out) {
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+
+    uint32_t k = 0;
+    for (; k + 8 <= num_offsets; k += 8) {
+        __m128d acc0 = _mm_loadu_pd(out + k);
+        __m128d acc1 = _mm_loadu_pd(out + k + 2);
+        __m128d acc2 = _mm_loadu_pd(out + k + 4);
+        __m128d acc3 = _mm_loadu_pd(out + k + 6);
+
+        for (uint32_t i = 0; i < length; i++) {
+            __m128 p = _mm_set1_ps(prev[i]);
+            __m128 d0 = _mm_andnot_ps(sign_mask,
+                                      _mm_sub_ps(_mm_loadu_ps(samples + k + i), p));
+            __m128 d1 = _mm_andnot_ps(sign_mask,
+                                      _mm_sub_ps(_mm_loadu_ps(samples + k + i + 4), p));
+
+            acc0 = _mm_add_pd(acc0, _mm_cvtps_pd(d0));
+            acc1 = _mm_add_pd(acc1, _mm_cvtps_pd(_mm_movehl_ps(d0, d0)));
+            acc2 = _mm_add_pd(acc2, _mm_cvtps_pd(d1));
+            acc3 = _mm_add_pd(acc3, _mm_cvtps_pd(_mm_movehl_ps(d1, d1)));
+        }
+
+        _mm_storeu_pd(out + k, acc0);
+        _mm_storeu_pd(out + k + 2, acc1);
+        _mm_storeu_pd(out + k + 4, acc2);
+        _mm_storeu_pd(out + k + 6, acc3);
+    }
+
+    return k;
+}
+
+OSMIUM_TARGET("avx2")
+uint32_t accumulate_abs_diffs_avx2(const float* samples,
+                                   const float* prev,
+                                   uint32_t length,
+                                   uint32_t num_offsets,
+                                   double* out) {
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+
+    uint32_t k = 0;
+    for (; k + 16 <= num_offsets; k += 16) {
+        __m256d acc0 = _mm256_loadu_pd(out + k);
+        __m256d acc1 = _mm256_loadu_pd(out + k + 4);
+        __m256d acc2 = _mm256_loadu_pd(out + k + 8);
+        __m256d acc3 = _mm256_loadu_pd(out + k + 12);
+
+        for (uint32_t i = 0; i < length; i++) {
+            __m256 p = _mm256_set1_ps(prev[i]);
+            __m256 d0 = _mm256_andnot_ps(
+                sign_mask, _mm256_sub_ps(_mm256_loadu_ps(samples + k + i), p));
+            __m256 d1 = _mm256_andnot_ps(
+                sign_mask, _mm256_sub_ps(_mm256_loadu_ps(samples + k + i + 8), p));
+
+            acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm256_castps256_ps128(d0)));
+            acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm256_extractf128_ps(d0, 1)));
+            acc2 = _mm256_add_pd(acc2, _mm256_cvtps_pd(_mm256_castps256_ps128(d1)));
+            acc3 = _mm256_add_pd(acc3, _mm256_cvtps_pd(_mm256_extractf128_ps(d1, 1)));
+        }
+
+        _mm256_storeu_pd(out + k, acc0);
+        _mm256_storeu_pd(out + k + 4, acc1);
+        _mm256_storeu_pd(out + k + 8, acc2);
+        _mm256_storeu_pd(out + k + 12, acc3);
+    }
+
+    return k;
+}
+
+OSMIUM_TARGET("avx512f")
+uint32_t accumulate_abs_diffs_avx512(const float* samples,
+                                     const float* prev,
+                                     uint32_t length,
+                                     uint32_t num_offsets,
+                                     double* out) {
+    uint32_t k = 0;
+    for (; k + 32 <= num_offsets; k += 32) {
+        __m512d acc0 = _mm512_loadu_pd(out + k);
+        __m512d acc1 = _mm512_loadu_pd(out + k + 8);
+        __m512d acc2 = _mm512_loadu_pd(out + k + 16);
+        __m512d acc3 = _mm512_loadu_pd(out + k + 24);
+
+        for (uint32_t i = 0; i < length; i++) {
+            __m512 p = _mm512_set1_ps(prev[i]);
+            __m512 d0 = _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(samples + k + i), p));
+            __m512 d1 =
+                _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(samples + k + i + 16), p));
+
+            acc0 = _mm512_add_pd(acc0, _mm512_cvtps_pd(_mm512_castps512_ps256(d0)));
+            acc1 = _mm512_add_pd(
+                acc1,
+                _mm512_cvtps_pd(_mm256_castpd_ps(
+                    _mm512_extractf64x4_pd(_mm512_castps_pd(d0), 1))));
+            acc2 = _mm512_add_pd(acc2, _mm512_cvtps_pd(_mm512_castps512_ps256(d1)));
+            acc3 = _mm512_add_pd(
+                acc3,
+                _mm512_cvtps_pd(_mm256_castpd_ps(
+                    _mm512_extractf64x4_pd(_mm512_castps_pd(d1), 1))));
+        }
+
+        _mm512_storeu_pd(out + k, acc0);
+        _mm512_storeu_pd(out + k + 8, acc1);
+        _mm512_storeu_pd(out + k + 16, acc2);
+        _mm512_storeu_pd(out + k + 24, acc3);
+    }
+
+    return k;
+}
+
+#ifdef _MSC_VER
+
+bool cpu_supports(SimdLevel level) {
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    bool has_osxsave = info[2] & (1 << 27);
+    bool has_avx = info[2] & (1 << 28);
+    if (!has_osxsave || !has_avx || max_leaf < 7)
+        return level <= SimdLevel::SSE2;
+
+    // Make sure the OS saves the YMM (and for AVX-512, ZMM/opmask) registers
+    unsigned long long xcr0 = _xgetbv(0);
+    bool os_avx = (xcr0 & 0x6) == 0x6;
+    bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+
+    __cpuidex(info, 7, 0);
+    bool has_avx2 = info[1] & (1 << 5);
+    bool has_avx512f = info[1] & (1 << 16);
+
+    switch (level) {
+    case SimdLevel::Scalar:
+    case SimdLevel::SSE2:
+        return true;
+    case SimdLevel::AVX2:
+        return os_avx && has_avx2;
+    case SimdLevel::AVX512:
+        return os_avx512 && has_avx512f;
+    }
+    return false;
+}
+
+#else
+
+bool cpu_supports(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar:
+        return true;
+    case SimdLevel::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case SimdLevel::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case SimdLevel::AVX512:
+        return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+}
+
+#endif // _MSC_VER
+
+#endif // OSMIUM_X86
+
+} // namespace
+
+SimdLevel detect_simd_level() {
+#ifdef OSMIUM_X86
+    static const SimdLevel level = [] {
+        for (auto level : {SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE2}) {
+            if (cpu_supports(level))
+                return level;
+        }
+        return SimdLevel::Scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* to_string(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar:
+        return "scalar";
+    case SimdLevel::SSE2:
+        return "SSE2";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::AVX512:
+        return "AVX-512";
+    }
+    return "";
+}
+
+void sum_abs_diffs(const float* samples,
+                   const float* prev,
+                   uint32_t length,
+                   uint32_t num_offsets,
+                   double* out) {
+    sum_abs_diffs(detect_simd_level(), samples, prev, length, num_offsets, out);
+}
+
+void sum_abs_diffs(SimdLevel level,
+                   const float* samples,
+                   const float* prev,
+                   uint32_t length,
+                   uint32_t num_offsets,
+                   double* out) {
+    std::fill_n(out, num_offsets, 0.0);
+    accumulate_abs_diffs(level, samples, prev, length, num_offsets, out);
+}
+
+void accumulate_abs_diffs(const float* samples,
+                          const float* prev,
+                          uint32_t length,
+                          uint32_t num_offsets,
+                          double* out) {
+    accumulate_abs_diffs(detect_simd_level(), samples, prev, length, num_offsets, out);
+}
+
+void accumulate_abs_diffs(SimdLevel level,
+                          const float* samples,
+                          const float* prev,
+                          uint32_t length,
+                          uint32_t num_offsets,
+                          double* out) {
+    uint32_t k = 0;
+
+#ifdef OSMIUM_X86
+    // Fall through from the widest kernel to the narrowest; each one picks up where the
+    // previous one left off.
+    switch (level) {
+    case SimdLevel::AVX512:
+        k += accumulate_abs_diffs_avx512(samples, prev, length, num_offsets, out);
+        [[fallthrough]];
+    case SimdLevel::AVX2:
+        k += accumulate_abs_diffs_avx2(
+            samples + k, prev, length, num_offsets - k, out + k);
+        [[fallthrough]];
+    case SimdLevel::SSE2:
+        k += accumulate_abs_diffs_sse2(
+            samples + k, prev, length, num_offsets - k, out + k);
+        [[fallthrough]];
+    case SimdLevel::Scalar:
+        break;
+    }
+#endif
+
+    accumulate_abs_diffs_scalar(samples + k, prev, length, num_offsets - k, out + k);
+}
+
+// -- CrossCorrelator --
+
+CrossCorrelator::CrossCorrelator(uint32_t length, uint32_t num_offsets)
+    : m_length(length),
+      m_num_offsets(num_offsets),
+      // Pad to avoid circular wraparound: every product samples[k + i] * prev[i] must
+      // land in a distinct bin for k < num_offsets.
+      m_plan(std::bit_ceil(static_cast<size_t>(length) + num_offsets)),
+      m_buffer(m_plan.size()),
+      m_product(m_plan.size()) {}
+
+void CrossCorrelator::sum_squared_diffs(const float* samples,
+                                        const float* prev,
+                                        double* out) {
+    size_t n = m_plan.size();
+    size_t num_samples = static_cast<size_t>(m_length) + m_num_offsets - 1;
+
+    // Both inputs are real, so transform them together as the real and imaginary parts
+    // of a single complex signal, then pull their spectra apart afterwards.
+    for (size_t i = 0; i < n; i++) {
+        double re = i < num_samples ? samples[i] : 0.0;
+        double im = i < m_length ? prev[i] : 0.0;
+        m_buffer[i] = {re, im};
+    }
+    m_plan.forward(m_buffer.data());
+
+    for (size_t k = 0; k < n; k++) {
+        std::complex<double> z = m_buffer[k];
+        std::complex<double> z_mirror = std::conj(m_buffer[(n - k) % n]);
+        std::complex<double> a = (z + z_mirror) * 0.5;
+        std::complex<double> b = (z - z_mirror) * 0.5;
+
+        // a * conj(b / i), multiplied out by hand
+        m_product[k] = {a.real() * b.imag() - a.imag() * b.real(),
+                        a.real() * b.real() + a.imag() * b.imag()};
+    }
+    m_plan.inverse(m_product.data());
+
+    double prev_energy = 0;
+    for (uint32_t i = 0; i < m_length; i++) {
+        prev_energy += static_cast<double>(prev[i]) * prev[i];
+    }
+
+    // Slide an energy window across `samples` alongside the correlation
+    double window_energy = 0;
+    for (uint32_t i = 0; i < m_length; i++) {
+        window_energy += static_cast<double>(samples[i]) * samples[i];
+    }
+
+    for (uint32_t k = 0; k < m_num_offsets; k++) {
+        out[k] = window_energy - 2.0 * m_product[k].real() + prev_energy;
+
+        if (k + 1 < m_num_offsets) {
+            double leaving = samples[k];
+            double entering = samples[k + m_length];
+            window_energy += entering * entering - leaving * leaving;
+        }
+    }
+}
+
+} // namespace osmium
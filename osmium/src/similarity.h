@@ -0,0 +1,94 @@
+#ifndef SIMILARITY_H
+#define SIMILARITY_H
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+#include "fft.h"
+
+namespace osmium {
+
+enum class SimdLevel { Scalar, SSE2, AVX2, AVX512 };
+
+/** Returns the widest instruction set supported by this build and the running CPU. */
+SimdLevel detect_simd_level();
+const char* to_string(SimdLevel level);
+
+/** Computes the sum of absolute differences between `prev` and a run of consecutive
+ *  windows of `samples`:
+ *
+ *      out[k] = sum(|samples[k + i] - prev[i]| for i in [0, length))
+ *
+ *  for every k in [0, num_offsets). `samples` must have at least
+ *  `length + num_offsets - 1` elements.
+ *
+ *  The vectorized kernels assign one candidate offset to each SIMD lane and accumulate
+ *  in double precision in increasing order of i, exactly like the scalar loop does. The
+ *  results are therefore bit-for-bit identical at every `SimdLevel`.
+ */
+void sum_abs_diffs(const float* samples,
+                   const float* prev,
+                   uint32_t length,
+                   uint32_t num_offsets,
+                   double* out);
+void sum_abs_diffs(SimdLevel level,
+                   const float* samples,
+                   const float* prev,
+                   uint32_t length,
+                   uint32_t num_offsets,
+                   double* out);
+
+/** Like `sum_abs_diffs()`, but adds onto the existing values of `out` instead of
+ *  overwriting them. The accumulation carries on exactly where it left off, so summing a
+ *  window in several consecutive pieces gives the same result as summing it all at once.
+ */
+void accumulate_abs_diffs(const float* samples,
+                          const float* prev,
+                          uint32_t length,
+                          uint32_t num_offsets,
+                          double* out);
+void accumulate_abs_diffs(SimdLevel level,
+                          const float* samples,
+                          const float* prev,
+                          uint32_t length,
+                          uint32_t num_offsets,
+                          double* out);
+
+/** Computes the sum of squared differences between `prev` and every candidate window of
+ *  `samples` at once, using FFT-based cross-correlation:
+ *
+ *      out[k] = sum((samples[k + i] - prev[i])^2 for i in [0, length))
+ *             = energy(samples[k : k + length]) - 2 * xcorr(samples, prev)[k]
+ *               + energy(prev)
+ *
+ *  This costs O(N log N) in the padded window length instead of O(length * num_offsets).
+ *  The FFT plan and all scratch buffers are allocated up front, so a correlator should
+ *  be built once and reused for every frame.
+ *
+ *  The result is subject to floating-point cancellation and may be very slightly
+ *  negative when a window matches `prev` almost exactly.
+ */
+class CrossCorrelator {
+public:
+    CrossCorrelator(uint32_t length, uint32_t num_offsets);
+
+    uint32_t get_length() const { return m_length; }
+    uint32_t get_num_offsets() const { return m_num_offsets; }
+
+    /** `samples` must have at least `length + num_offsets - 1` elements, and `out` must
+     *  have room for `num_offsets` elements.
+     */
+    void sum_squared_diffs(const float* samples, const float* prev, double* out);
+
+private:
+    uint32_t m_length;
+    uint32_t m_num_offsets;
+    FftPlan m_plan;
+    std::vector<std::complex<double>> m_buffer;
+    std::vector<std::complex<double>> m_product;
+};
+
+} // namespace osmium
+
+#endif // SIMILARITY_H
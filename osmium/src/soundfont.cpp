@@ -0,0 +1,154 @@
+#include "soundfont.h"
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <bass.h>
+#include <bassmidi.h>
+
+#include "error.h"
+
+namespace fs = std::filesystem;
+
+namespace osmium {
+
+namespace {
+
+struct CacheEntry {
+    fs::file_time_type mtime;
+    std::shared_ptr<SoundFont> font;
+};
+
+// Keyed by (canonical path, mmap flag)
+using CacheKey = std::tuple<std::string, bool>;
+
+std::mutex g_cache_mutex;
+std::map<CacheKey, CacheEntry> g_cache;
+
+} // namespace
+
+// -- SoundFont --
+
+SoundFont::SoundFont(uint32_t handle, std::string filename)
+    : m_handle(handle), m_filename(std::move(filename)) {}
+
+SoundFont::~SoundFont() {
+    if (m_handle) {
+        BASS_MIDI_FontFree(m_handle);
+        m_handle = 0;
+    }
+}
+
+// -- Cache --
+
+std::shared_ptr<SoundFont> load_soundfont(const std::string& filename, bool mmap) {
+    std::error_code ec;
+    fs::path path = fs::weakly_canonical(filename, ec);
+    if (ec)
+        path = filename;
+    fs::file_time_type mtime = fs::last_write_time(path, ec);
+
+    std::scoped_lock lock(g_cache_mutex);
+    CacheKey key(path.string(), mmap);
+    if (auto it = g_cache.find(key); it != g_cache.end()) {
+        // If the file changed since it was loaded, load it again. Streams still holding
+        // the old font keep it alive until they're done with it.
+        if (it->second.mtime == mtime)
+            return it->second.font;
+        g_cache.erase(it);
+    }
+
+    HSOUNDFONT handle =
+        BASS_MIDI_FontInit(filename.c_str(), mmap ? BASS_MIDI_FONT_MMAP : 0);
+    if (!handle)
+        throw Error::from_bass_error("Error initializing soundfont: ");
+
+    auto font = std::make_shared<SoundFont>(handle, filename);
+    g_cache.emplace(key, CacheEntry{.mtime = mtime, .font = font});
+    return font;
+}
+
+std::vector<std::shared_ptr<SoundFont>> load_soundfonts(
+    const std::vector<std::string>& filenames, bool mmap) {
+    std::vector<std::shared_ptr<SoundFont>> fonts;
+    fonts.reserve(filenames.size());
+    for (const auto& filename : filenames) {
+        fonts.push_back(load_soundfont(filename, mmap));
+    }
+    return fonts;
+}
+
+// -- Preloading --
+
+PreloadReport preload_presets(const std::vector<std::shared_ptr<SoundFont>>& fonts,
+                              const std::vector<Preset>& presets,
+                              unsigned num_threads) {
+    // Earlier fonts in the stack take precedence, so a preset only ever plays from the
+    // first font that has it. Loading it from any of the others would be wasted memory.
+    auto load_first = [&fonts](int program, int bank) {
+        return std::ranges::any_of(fonts, [=](const auto& font) {
+            return BASS_MIDI_FontLoad(**font, program, bank) != 0;
+        });
+    };
+
+    std::atomic<size_t> next_job = 0;
+    auto worker = [&]() {
+        for (size_t job = next_job++; job < presets.size(); job = next_job++) {
+            const Preset& preset = presets[job];
+            if (load_first(preset.program, preset.bank))
+                continue;
+
+            // Presets no font has fall back to bank 0, and missing drum kits to the
+            // standard kit
+            if (preset.bank == Preset::DRUM_BANK) {
+                load_first(0, Preset::DRUM_BANK);
+            } else if (preset.bank != 0) {
+                load_first(preset.program, 0);
+            }
+        }
+    };
+
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = static_cast<unsigned>(std::min<size_t>(num_threads, presets.size()));
+
+    {
+        std::vector<std::jthread> threads;
+        for (unsigned t = 0; t < num_threads; t++) {
+            threads.emplace_back(worker);
+        }
+    }
+
+    PreloadReport report{.num_presets = presets.size()};
+    for (const auto& font : fonts) {
+        BASS_MIDI_FONTINFO info;
+        if (!BASS_MIDI_FontGetInfo(**font, &info))
+            throw Error::from_bass_error("Error getting soundfont info: ");
+        report.total_sample_bytes += info.samsize;
+        report.loaded_sample_bytes += info.samload;
+    }
+    return report;
+}
+
+void release_unused_soundfonts() {
+    std::scoped_lock lock(g_cache_mutex);
+    std::erase_if(g_cache, [](const auto& item) {
+        return item.second.font.use_count() == 1;
+    });
+}
+
+} // namespace osmium
@@ -0,0 +1,93 @@
+#ifndef SOUNDFONT_H
+#define SOUNDFONT_H
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace osmium {
+
+/** An initialized BASSMIDI soundfont. The underlying handle is freed when the last
+ *  `std::shared_ptr` to it goes away, so a single font can be shared between any number
+ *  of streams.
+ */
+class SoundFont {
+public:
+    SoundFont(uint32_t handle, std::string filename);
+
+    SoundFont(const SoundFont&) = delete;
+    SoundFont& operator=(const SoundFont&) = delete;
+    ~SoundFont();
+
+    uint32_t operator*() const { return m_handle; }
+    const std::string& get_filename() const { return m_filename; }
+
+private:
+    uint32_t m_handle;
+    std::string m_filename;
+};
+
+/** A preset (instrument) in a soundfont. As in BASSMIDI, drum kits live in bank 128. */
+struct Preset {
+    static constexpr int DRUM_BANK = 128;
+
+    int bank;
+    int program;
+
+    auto operator<=>(const Preset&) const = default;
+};
+
+/** The outcome of `preload_presets()`. */
+struct PreloadReport {
+    size_t num_presets = 0;
+    // Sample data in the fonts, and how much of it is in memory after preloading
+    uint64_t total_sample_bytes = 0;
+    uint64_t loaded_sample_bytes = 0;
+
+    /** Memory saved compared with loading the fonts in full. */
+    uint64_t saved_bytes() const {
+        return total_sample_bytes > loaded_sample_bytes
+                   ? total_sample_bytes - loaded_sample_bytes
+                   : 0;
+    }
+};
+
+/** Synthesis settings that trade sound quality for speed. The defaults leave BASSMIDI's
+ *  own settings alone.
+ */
+struct SynthQuality {
+    uint32_t max_voices = 0; // Voices that can sound at once; 0 for the default
+
+    bool operator==(const SynthQuality&) const = default;
+};
+
+/** Returns the soundfont at `filename`, loading it if necessary.
+ *
+ *  Loaded fonts are kept in a process-wide cache keyed by path and modification time, so
+ *  every stream in a render (and every render after it) reuses the same font as long as
+ *  the file hasn't changed on disk. If `mmap` is true, the font's sample data is memory-
+ *  mapped rather than read into memory.
+ */
+std::shared_ptr<SoundFont> load_soundfont(const std::string& filename, bool mmap = false);
+std::vector<std::shared_ptr<SoundFont>> load_soundfonts(
+    const std::vector<std::string>& filenames, bool mmap = false);
+
+/** Loads the samples of `presets` up front, on up to `num_threads` threads (0 for one
+ *  per core), instead of letting BASSMIDI load them lazily the first time a note needs
+ *  them. Each preset is loaded only from the first font in `fonts` that has it, since
+ *  that's the one that plays. Where no font has a preset, the one BASSMIDI would fall
+ *  back to is loaded instead.
+ */
+PreloadReport preload_presets(const std::vector<std::shared_ptr<SoundFont>>& fonts,
+                              const std::vector<Preset>& presets,
+                              unsigned num_threads = 0);
+
+/** Drops every cached soundfont that isn't currently in use by a stream. */
+void release_unused_soundfonts();
+
+} // namespace osmium
+
+#endif // SOUNDFONT_H
@@ -0,0 +1,181 @@
+#include "stemcache.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "hashing.h"
+
+namespace fs = std::filesystem;
+
+namespace osmium {
+
+namespace {
+
+constexpr std::array<char, 4> STEM_MAGIC{'O', 'S', 'S', 'T'};
+constexpr uint32_t STEM_VERSION = 1;
+
+} // namespace
+
+// -- Stem --
+
+Stem::Stem(const fs::path& path) : m_file(path) {
+    if (m_file.size() < sizeof(StemHeader))
+        throw Error("Stem file is truncated: " + path.string());
+
+    std::memcpy(&m_header, m_file.data(), sizeof(StemHeader));
+    if (std::memcmp(m_header.magic, STEM_MAGIC.data(), STEM_MAGIC.size()) != 0
+        || m_header.version != STEM_VERSION)
+        throw Error("Not a valid stem file: " + path.string());
+
+    uint64_t data_size = m_header.num_frames * m_header.num_channels * sizeof(float);
+    if (m_file.size() - sizeof(StemHeader) < data_size)
+        throw Error("Stem file is truncated: " + path.string());
+}
+
+const float* Stem::data() const {
+    return reinterpret_cast<const float*>(m_file.data() + sizeof(StemHeader));
+}
+
+// -- StemWriter --
+
+StemWriter::StemWriter(fs::path path, uint32_t sample_rate, uint32_t num_channels)
+    : m_path(std::move(path)),
+      m_header{.version = STEM_VERSION,
+               .sample_rate = sample_rate,
+               .num_channels = num_channels,
+               .num_frames = 0} {
+    std::memcpy(m_header.magic, STEM_MAGIC.data(), STEM_MAGIC.size());
+
+    m_part_path = m_path;
+    m_part_path += ".part";
+    m_stream.open(m_part_path, std::ios::binary | std::ios::trunc);
+    if (!m_stream)
+        throw Error("Could not create stem file " + m_part_path.string());
+
+    // Write a placeholder header; the frame count is filled in by finish()
+    m_stream.write(reinterpret_cast<const char*>(&m_header), sizeof(StemHeader));
+}
+
+// A moved-from writer is left with an empty part path, so it won't delete the file
+StemWriter::StemWriter(StemWriter&& other) noexcept
+    : m_path(std::move(other.m_path)),
+      m_part_path(std::exchange(other.m_part_path, {})),
+      m_stream(std::move(other.m_stream)),
+      m_header(other.m_header),
+      m_finished(std::exchange(other.m_finished, true)) {}
+
+StemWriter& StemWriter::operator=(StemWriter&& other) noexcept {
+    if (this != &other) {
+        discard();
+        m_path = std::move(other.m_path);
+        m_part_path = std::exchange(other.m_part_path, {});
+        m_stream = std::move(other.m_stream);
+        m_header = other.m_header;
+        m_finished = std::exchange(other.m_finished, true);
+    }
+    return *this;
+}
+
+StemWriter::~StemWriter() {
+    discard();
+}
+
+void StemWriter::write(const float* samples, uint32_t num_frames) {
+    m_stream.write(reinterpret_cast<const char*>(samples),
+                   static_cast<std::streamsize>(num_frames) * m_header.num_channels
+                       * sizeof(float));
+    m_header.num_frames += num_frames;
+}
+
+bool StemWriter::finish() {
+    m_stream.seekp(0);
+    m_stream.write(reinterpret_cast<const char*>(&m_header), sizeof(StemHeader));
+    m_stream.close();
+    if (m_stream.fail())
+        return false;
+
+    // Renaming may fail if another render is reading the old stem; that's harmless
+    std::error_code ec;
+    fs::rename(m_part_path, m_path, ec);
+    m_finished = !ec;
+    return m_finished;
+}
+
+void StemWriter::discard() {
+    if (!m_finished && !m_part_path.empty()) {
+        m_stream.close();
+        std::error_code ec;
+        fs::remove(m_part_path, ec);
+    }
+}
+
+// -- StemCache --
+
+StemCache::StemCache(const fs::path& root,
+                     const std::string& midi_filename,
+                     const std::vector<std::string>& soundfonts,
+                     uint32_t sample_rate,
+                     uint32_t synth_flags,
+                     const SynthQuality& quality)
+    : m_sample_rate(sample_rate) {
+    uint64_t key =
+        source_key(midi_filename, soundfonts, sample_rate, synth_flags, quality);
+    m_dir = root / std::format("{:016x}", key);
+}
+
+uint64_t StemCache::source_key(const std::string& midi_filename,
+                               const std::vector<std::string>& soundfonts,
+                               uint32_t sample_rate,
+                               uint32_t synth_flags,
+                               const SynthQuality& quality) {
+    Hasher hasher;
+    hasher.update(STEM_VERSION);
+    hash_file_contents(hasher, midi_filename);
+
+    // Soundfonts can be gigabytes in size, so identify them by path, size and
+    // modification time rather than by their contents.
+    for (const auto& sf : soundfonts) {
+        std::error_code ec;
+        hasher.update(fs::weakly_canonical(sf, ec).string());
+        hasher.update(static_cast<uint64_t>(fs::file_size(sf, ec)));
+        hasher.update(fs::last_write_time(sf, ec).time_since_epoch().count());
+    }
+
+    hasher.update(sample_rate);
+    hasher.update(synth_flags);
+    hasher.update(quality.max_voices);
+    return hasher.digest();
+}
+
+bool StemCache::has_stem(int channel) const {
+    std::error_code ec;
+    return fs::is_regular_file(stem_path(channel), ec);
+}
+
+Stem StemCache::open_stem(int channel) const {
+    Stem stem(stem_path(channel));
+    if (stem.get_sample_rate() != m_sample_rate)
+        throw Error("Stem sample rate doesn't match: " + stem_path(channel).string());
+    return stem;
+}
+
+StemWriter StemCache::create_writer(int channel, uint32_t num_channels) const {
+    fs::create_directories(m_dir);
+    return {stem_path(channel), m_sample_rate, num_channels};
+}
+
+fs::path StemCache::stem_path(int channel) const {
+    if (channel == MASTER)
+        return m_dir / "master.f32";
+    return m_dir / std::format("ch{:02}.f32", channel);
+}
+
+} // namespace osmium
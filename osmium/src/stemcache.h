@@ -0,0 +1,102 @@
+#ifndef STEMCACHE_H
+#define STEMCACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+#include "soundfont.h"
+
+namespace osmium {
+
+struct StemHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t sample_rate;
+    uint32_t num_channels;
+    uint64_t num_frames;
+};
+
+/** A memory-mapped stem file of interleaved float samples. */
+class Stem {
+public:
+    explicit Stem(const std::filesystem::path& path);
+
+    uint32_t get_sample_rate() const { return m_header.sample_rate; }
+    uint32_t get_num_channels() const { return m_header.num_channels; }
+    uint64_t get_num_frames() const { return m_header.num_frames; }
+    const float* data() const;
+
+private:
+    MappedFile m_file;
+    StemHeader m_header;
+};
+
+/** Writes a stem file. Data goes to a temporary file which only replaces the real one
+ *  once `finish()` is called, so an interrupted render never leaves a truncated stem.
+ */
+class StemWriter {
+public:
+    StemWriter(std::filesystem::path path, uint32_t sample_rate, uint32_t num_channels);
+
+    StemWriter(const StemWriter&) = delete;
+    StemWriter& operator=(const StemWriter&) = delete;
+    StemWriter(StemWriter&& other) noexcept;
+    StemWriter& operator=(StemWriter&& other) noexcept;
+    ~StemWriter();
+
+    void write(const float* samples, uint32_t num_frames);
+    bool finish();
+
+private:
+    std::filesystem::path m_path;
+    std::filesystem::path m_part_path;
+    std::ofstream m_stream;
+    StemHeader m_header;
+    bool m_finished = false;
+
+    void discard();
+};
+
+/** A directory of synthesized stems for one combination of MIDI file, soundfonts, sample
+ *  rate and synth settings. Each MIDI channel and the master mix get their own file.
+ */
+class StemCache {
+public:
+    static constexpr int MASTER = -1;
+
+    StemCache(const std::filesystem::path& root,
+              const std::string& midi_filename,
+              const std::vector<std::string>& soundfonts,
+              uint32_t sample_rate,
+              uint32_t synth_flags,
+              const SynthQuality& quality = {});
+
+    /** Identifies the audio a synth with these settings produces. Also used to key other
+     *  caches derived from that audio.
+     */
+    static uint64_t source_key(const std::string& midi_filename,
+                               const std::vector<std::string>& soundfonts,
+                               uint32_t sample_rate,
+                               uint32_t synth_flags,
+                               const SynthQuality& quality = {});
+
+    const std::filesystem::path& get_dir() const { return m_dir; }
+
+    bool has_stem(int channel) const;
+    Stem open_stem(int channel) const;
+    StemWriter create_writer(int channel, uint32_t num_channels) const;
+
+private:
+    std::filesystem::path m_dir;
+    uint32_t m_sample_rate;
+
+    std::filesystem::path stem_path(int channel) const;
+};
+
+} // namespace osmium
+
+#endif // STEMCACHE_H
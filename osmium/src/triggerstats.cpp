@@ -0,0 +1,115 @@
+#include "triggerstats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+namespace osmium {
+
+namespace {
+
+/** The `fraction` quantile of `values` (nearest rank). Reorders `values`. */
+double quantile(std::vector<double>& values, double fraction) {
+    if (values.empty())
+        return 0.0;
+
+    auto rank = static_cast<size_t>(std::ceil(fraction * values.size()));
+    auto nth = values.begin() + std::clamp<size_t>(rank, 1, values.size()) - 1;
+    std::ranges::nth_element(values, nth);
+    return *nth;
+}
+
+double mean(const std::vector<double>& values) {
+    if (values.empty())
+        return 0.0;
+    return std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+}
+
+/** Adds up |a - b| and |a| + |b| over `a` and `b`, and then replaces `b` with `a`. Does
+ *  nothing if the two aren't the same size.
+ */
+void compare_and_keep(const std::vector<float>& a,
+                      std::vector<float>& b,
+                      double& difference,
+                      double& magnitude) {
+    if (a.size() == b.size()) {
+        for (size_t i = 0; i < a.size(); i++) {
+            difference += std::abs(a[i] - b[i]);
+            magnitude += std::abs(a[i]) + std::abs(b[i]);
+        }
+    }
+    b = a;
+}
+
+} // namespace
+
+void TriggerStatsCollector::add_frame(const Scope& scope, std::chrono::nanoseconds cost) {
+    m_costs_us.push_back(std::chrono::duration<double, std::micro>(cost).count());
+    m_replayed = scope.is_replaying_trigger_track();
+
+    // Going silent and coming back aren't jumps, so start over after a frame with no
+    // nudge rather than comparing against the 0 it falls back to
+    if (scope.get_no_nudges_found()) {
+        m_no_nudge_frames++;
+        m_last_nudge_ms.reset();
+    } else {
+        double nudge_ms = scope.get_this_nudge_ms();
+        if (m_last_nudge_ms)
+            m_changes_ms.push_back(std::abs(nudge_ms - *m_last_nudge_ms));
+        m_last_nudge_ms = nudge_ms;
+    }
+
+    bool is_first_frame = m_costs_us.size() == 1;
+    double difference = 0.0;
+    double magnitude = 0.0;
+    compare_and_keep(scope.get_left_samples(), m_last_left, difference, magnitude);
+    compare_and_keep(scope.get_right_samples(), m_last_right, difference, magnitude);
+    if (!is_first_frame && magnitude > 0.0) {
+        m_wave_change_sum += difference / magnitude;
+        m_wave_change_frames++;
+    }
+}
+
+TriggerStats TriggerStatsCollector::summarize() const {
+    auto changes = m_changes_ms;
+    auto costs = m_costs_us;
+
+    TriggerStats stats{
+        .num_frames = costs.size(),
+        .no_nudge_frames = m_no_nudge_frames,
+        .changed_frames = static_cast<uint64_t>(
+            std::ranges::count_if(changes, [](double c) { return c != 0.0; })),
+        .mean_change_ms = mean(changes),
+        .mean_wave_change =
+            m_wave_change_frames ? m_wave_change_sum / m_wave_change_frames : 0.0,
+        .mean_cost_us = mean(costs),
+        .replayed = m_replayed,
+    };
+
+    if (!changes.empty())
+        stats.max_change_ms = std::ranges::max(changes);
+    if (!costs.empty())
+        stats.max_cost_us = std::ranges::max(costs);
+    stats.median_change_ms = quantile(changes, 0.5);
+    stats.p95_change_ms = quantile(changes, 0.95);
+    stats.p99_cost_us = quantile(costs, 0.99);
+
+    return stats;
+}
+
+TriggerStats analyze_triggers(Scope& scope) {
+    using clock = std::chrono::steady_clock;
+
+    TriggerStatsCollector collector;
+    while (scope.is_playing()) {
+        auto start = clock::now();
+        scope.next_wave_data();
+        collector.add_frame(scope, clock::now() - start);
+    }
+    return collector.summarize();
+}
+
+} // namespace osmium
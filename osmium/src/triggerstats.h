@@ -0,0 +1,77 @@
+#ifndef TRIGGERSTATS_H
+#define TRIGGERSTATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "scope.h"
+
+namespace osmium {
+
+/** How steadily a scope triggered over a render, and what it cost. */
+struct TriggerStats {
+    uint64_t num_frames = 0;
+    uint64_t no_nudge_frames = 0; // Frames where `get_no_nudges_found()` was true
+    uint64_t changed_frames = 0;  // Frames whose nudge differed from the last frame's
+
+    // Distribution of |change in nudge| from one frame to the next, in ms. Only counts
+    // pairs of consecutive frames that both found a nudge; a frame without one has
+    // nothing to jump from or to.
+    double mean_change_ms = 0.0;
+    double median_change_ms = 0.0;
+    double p95_change_ms = 0.0;
+    double max_change_ms = 0.0;
+
+    // How much the displayed waveform changes from one frame to the next: the sum of
+    // |difference| between the two frames' samples, over the sum of their magnitudes.
+    // 0 means a perfectly still picture, 1 means no resemblance at all. Averaged over
+    // the frames where anything was playing.
+    double mean_wave_change = 0.0;
+
+    // Time spent in `Scope::next_wave_data()` per frame, in microseconds. Includes
+    // reading the frame's audio from the source.
+    double mean_cost_us = 0.0;
+    double p99_cost_us = 0.0;
+    double max_cost_us = 0.0;
+
+    bool replayed = false; // Whether the nudges came from a saved trigger track
+
+    double no_nudge_rate() const {
+        return num_frames ? static_cast<double>(no_nudge_frames) / num_frames : 0.0;
+    }
+    double changed_rate() const {
+        return num_frames ? static_cast<double>(changed_frames) / num_frames : 0.0;
+    }
+};
+
+/** Gathers `TriggerStats` for a scope one frame at a time. */
+class TriggerStatsCollector {
+public:
+    /** Records the frame `scope` just produced, which took `cost` to compute. */
+    void add_frame(const Scope& scope, std::chrono::nanoseconds cost);
+
+    TriggerStats summarize() const;
+
+private:
+    std::vector<double> m_changes_ms;
+    std::vector<double> m_costs_us;
+    uint64_t m_no_nudge_frames = 0;
+    std::optional<double> m_last_nudge_ms; // Empty if the last frame had no nudge
+
+    std::vector<float> m_last_left;
+    std::vector<float> m_last_right;
+    double m_wave_change_sum = 0.0;
+    uint64_t m_wave_change_frames = 0;
+    bool m_replayed = false;
+};
+
+/** Runs `scope` to the end as fast as possible, without drawing anything, and reports
+ *  how it triggered.
+ */
+TriggerStats analyze_triggers(Scope& scope);
+
+} // namespace osmium
+
+#endif // TRIGGERSTATS_H
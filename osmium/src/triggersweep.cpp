@@ -0,0 +1,284 @@
+#include "triggersweep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "samplesource.h"
+
+namespace osmium {
+
+namespace {
+
+// An untriggered frame counts as much as a frame where half the waveform changed
+constexpr double NO_NUDGE_PENALTY = 0.5;
+// An average jump the size of the whole nudge range counts as much as a frame where a
+// quarter of the waveform changed
+constexpr double JITTER_WEIGHT = 0.25;
+// Frames to synthesize at a time when decoding the channels
+constexpr uint32_t DECODE_BLOCK_FRAMES = 4096;
+
+/** Replaces each config with one copy per value in `values`, with `field` set to that
+ *  value. Does nothing if `values` is empty.
+ */
+template<typename T>
+void expand(std::vector<TriggerConfig>& configs,
+            const std::vector<T>& values,
+            T TriggerConfig::*field) {
+    if (values.empty())
+        return;
+
+    std::vector<TriggerConfig> expanded;
+    expanded.reserve(configs.size() * values.size());
+    for (const auto& config : configs) {
+        for (const auto& value : values) {
+            expanded.push_back(config);
+            expanded.back().*field = value;
+        }
+    }
+    configs = std::move(expanded);
+}
+
+struct ChannelAudio {
+    std::shared_ptr<const std::vector<float>> samples;
+    uint32_t sample_rate;
+    uint32_t num_channels;
+};
+
+/** Synthesizes each of `channels` into memory, up to `max_frames` frames. Returns
+ *  nothing if aborted.
+ */
+std::map<int, ChannelAudio> decode_channels(const std::shared_ptr<MidiSynth>& synth,
+                                            const std::vector<int>& channels,
+                                            uint64_t max_frames,
+                                            const std::atomic<bool>* abort_requested) {
+    uint32_t num_channels = synth->get_num_channels();
+    uint64_t num_frames = std::min(synth->get_total_samples() / num_channels, max_frames);
+
+    // Every reader has to be registered before any of them reads
+    std::vector<std::unique_ptr<SynthChannelSource>> sources;
+    std::vector<std::vector<float>> buffers(channels.size());
+    for (size_t i = 0; i < channels.size(); i++) {
+        sources.push_back(std::make_unique<SynthChannelSource>(synth, channels[i]));
+        buffers[i].reserve(num_frames * num_channels);
+    }
+
+    // Read the channels in lockstep, so the synth never has to buffer much
+    std::vector<float> block(static_cast<size_t>(DECODE_BLOCK_FRAMES) * num_channels);
+    for (uint64_t frame = 0; frame < max_frames;) {
+        if (abort_requested && *abort_requested)
+            return {};
+
+        auto to_read = static_cast<uint32_t>(
+            std::min<uint64_t>(DECODE_BLOCK_FRAMES, max_frames - frame));
+        uint32_t most_read = 0;
+        for (size_t i = 0; i < sources.size(); i++) {
+            uint32_t frames_read = sources[i]->read(block.data(), to_read);
+            size_t samples_read = static_cast<size_t>(frames_read) * num_channels;
+            auto block_end = block.begin() + static_cast<ptrdiff_t>(samples_read);
+            buffers[i].insert(buffers[i].end(), block.begin(), block_end);
+            most_read = std::max(most_read, frames_read);
+        }
+
+        if (most_read == 0)
+            break;
+        frame += most_read;
+    }
+
+    std::map<int, ChannelAudio> audio;
+    for (size_t i = 0; i < channels.size(); i++) {
+        audio[channels[i]] = ChannelAudio{
+            .samples = std::make_shared<const std::vector<float>>(std::move(buffers[i])),
+            .sample_rate = synth->get_sample_rate(),
+            .num_channels = num_channels,
+        };
+    }
+    return audio;
+}
+
+/** Runs a scope with the given settings over all of `audio`. */
+TriggerStats evaluate(const ScopeBuilder& base,
+                      const TriggerConfig& config,
+                      const ChannelAudio& audio,
+                      const std::atomic<bool>& stop) {
+    using clock = std::chrono::steady_clock;
+
+    // The audio is already in memory, so there's nothing to read ahead
+    ScopeBuilder builder = base;
+    config.apply(builder);
+    builder.read_ahead_ms(0);
+    auto scope = builder.build_from_source(std::make_unique<MemorySource>(
+        audio.samples, audio.sample_rate, audio.num_channels));
+
+    TriggerStatsCollector collector;
+    while (scope.is_playing() && !stop) {
+        auto start = clock::now();
+        scope.next_wave_data();
+        collector.add_frame(scope, clock::now() - start);
+    }
+    return collector.summarize();
+}
+
+} // namespace
+
+// -- TriggerConfig --
+
+void TriggerConfig::apply(ScopeBuilder& builder) const {
+    builder.trigger_threshold(trigger_threshold)
+        .max_nudge_ms(max_nudge_ms)
+        .similarity_window_ms(similarity_window_ms)
+        .similarity_bias(similarity_bias)
+        .peak_threshold(peak_threshold)
+        .peak_bias(peak_bias)
+        .drift_window(drift_window)
+        .avoid_drift_bias(avoid_drift_bias)
+        .trigger_engine(trigger_engine);
+    if (!pitch_tracking) {
+        builder.note_tracker(std::nullopt);
+    }
+}
+
+// -- TriggerGrid --
+
+std::vector<TriggerConfig> TriggerGrid::combinations(const TriggerConfig& base) const {
+    std::vector<TriggerConfig> configs{base};
+    expand(configs, trigger_thresholds, &TriggerConfig::trigger_threshold);
+    expand(configs, max_nudges_ms, &TriggerConfig::max_nudge_ms);
+    expand(configs, similarity_windows_ms, &TriggerConfig::similarity_window_ms);
+    expand(configs, similarity_biases, &TriggerConfig::similarity_bias);
+    expand(configs, peak_thresholds, &TriggerConfig::peak_threshold);
+    expand(configs, peak_biases, &TriggerConfig::peak_bias);
+    expand(configs, drift_windows, &TriggerConfig::drift_window);
+    expand(configs, avoid_drift_biases, &TriggerConfig::avoid_drift_bias);
+    expand(configs, trigger_engines, &TriggerConfig::trigger_engine);
+    return configs;
+}
+
+std::vector<TriggerConfig> TriggerGrid::sample(const TriggerConfig& base,
+                                               size_t count,
+                                               uint64_t seed) const {
+    auto configs = combinations(base);
+    if (count < configs.size()) {
+        std::mt19937_64 rng(seed);
+        std::ranges::shuffle(configs, rng);
+        configs.resize(count);
+    }
+    return configs;
+}
+
+// -- Sweeping --
+
+double stability_score(const TriggerStats& stats, const TriggerConfig& config) {
+    // Relative to the nudge range, so configs with different ranges compare fairly
+    double jitter =
+        config.max_nudge_ms > 0 ? stats.mean_change_ms / config.max_nudge_ms : 0.0;
+    return stats.mean_wave_change + JITTER_WEIGHT * jitter
+           + NO_NUDGE_PENALTY * stats.no_nudge_rate();
+}
+
+std::vector<std::vector<SweepResult>> sweep_triggers(
+    const std::shared_ptr<MidiSynth>& synth,
+    const std::vector<SweepChannel>& channels,
+    const SweepOptions& options) {
+    std::vector<int> channel_numbers;
+    for (const auto& channel : channels) {
+        if (std::ranges::find(channel_numbers, channel.channel) == channel_numbers.end())
+            channel_numbers.push_back(channel.channel);
+    }
+
+    uint64_t max_frames = std::numeric_limits<uint64_t>::max();
+    if (options.max_seconds > 0.0) {
+        max_frames = std::llround(options.max_seconds * synth->get_sample_rate());
+    }
+
+    auto audio =
+        decode_channels(synth, channel_numbers, max_frames, options.abort_requested);
+    if (audio.empty() && !channel_numbers.empty())
+        return {};
+
+    // One job per (channel, config) pair, each with its own slot for the result
+    std::vector<std::pair<size_t, size_t>> jobs;
+    std::vector<std::vector<SweepResult>> results(channels.size());
+    for (size_t i = 0; i < channels.size(); i++) {
+        results[i].resize(channels[i].configs.size());
+        for (size_t j = 0; j < channels[i].configs.size(); j++) {
+            jobs.emplace_back(i, j);
+        }
+    }
+
+    std::atomic<size_t> next_job = 0;
+    std::atomic<size_t> jobs_done = 0;
+    std::atomic<bool> stop = false;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+        while (!stop) {
+            if (options.abort_requested && *options.abort_requested) {
+                stop = true;
+                break;
+            }
+
+            size_t job = next_job++;
+            if (job >= jobs.size())
+                break;
+
+            auto [i, j] = jobs[job];
+            const auto& channel = channels[i];
+            const auto& config = channel.configs[j];
+            const auto& channel_audio = audio.at(channel.channel);
+            try {
+                auto stats = evaluate(channel.base, config, channel_audio, stop);
+                double score = stability_score(stats, config);
+                results[i][j] = SweepResult{config, stats, score};
+            } catch (...) {
+                std::lock_guard lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+                stop = true;
+                break;
+            }
+
+            size_t done = ++jobs_done;
+            if (options.on_progress)
+                options.on_progress(static_cast<double>(done) / jobs.size());
+        }
+    };
+
+    unsigned num_threads = options.num_threads;
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = static_cast<unsigned>(std::min<size_t>(num_threads, jobs.size()));
+
+    {
+        std::vector<std::jthread> threads;
+        for (unsigned t = 0; t < num_threads; t++) {
+            threads.emplace_back(worker);
+        }
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+    if (stop)
+        return {};
+
+    for (auto& channel_results : results) {
+        std::ranges::stable_sort(channel_results, {}, &SweepResult::score);
+    }
+    return results;
+}
+
+} // namespace osmium
@@ -0,0 +1,103 @@
+#ifndef TRIGGERSWEEP_H
+#define TRIGGERSWEEP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "midisynth.h"
+#include "scope.h"
+#include "scopebuilder.h"
+#include "triggerstats.h"
+
+namespace osmium {
+
+/** The trigger settings a sweep varies. Defaults match `ScopeBuilder`'s. */
+struct TriggerConfig {
+    double trigger_threshold = 0.1;
+    int max_nudge_ms = 40;
+    int similarity_window_ms = 40;
+    double similarity_bias = 1.0;
+    double peak_threshold = 0.9;
+    double peak_bias = 0.5;
+    double drift_window = 0.0;
+    double avoid_drift_bias = 1.0;
+    TriggerEngine trigger_engine = TriggerEngine::Search;
+    // Whether to use the base builder's note tracker, if it has one
+    bool pitch_tracking = false;
+
+    /** Sets all of these options on `builder`. */
+    void apply(ScopeBuilder& builder) const;
+
+    bool operator==(const TriggerConfig&) const = default;
+};
+
+/** Values to try for each trigger setting. An empty list keeps the base setting. */
+struct TriggerGrid {
+    std::vector<double> trigger_thresholds;
+    std::vector<int> max_nudges_ms;
+    std::vector<int> similarity_windows_ms;
+    std::vector<double> similarity_biases;
+    std::vector<double> peak_thresholds;
+    std::vector<double> peak_biases;
+    std::vector<double> drift_windows;
+    std::vector<double> avoid_drift_biases;
+    std::vector<TriggerEngine> trigger_engines;
+
+    /** Every combination of the listed values. */
+    std::vector<TriggerConfig> combinations(const TriggerConfig& base) const;
+
+    /** Up to `count` distinct combinations, picked at random. */
+    std::vector<TriggerConfig> sample(const TriggerConfig& base,
+                                      size_t count,
+                                      uint64_t seed) const;
+};
+
+struct SweepResult {
+    TriggerConfig config;
+    TriggerStats stats;
+    double score; // See `stability_score()`
+};
+
+/** How badly a scope triggered with `config`; lower is better. The mean frame-to-frame
+ *  change of the displayed waveform, plus the mean jump in nudge as a fraction of
+ *  `config.max_nudge_ms`, plus a penalty for each frame where no trigger point was found.
+ */
+double stability_score(const TriggerStats& stats, const TriggerConfig& config);
+
+/** The configurations to try on one channel. */
+struct SweepChannel {
+    int channel;
+    ScopeBuilder base; // Every setting that isn't part of the `TriggerConfig`
+    std::vector<TriggerConfig> configs;
+};
+
+struct SweepOptions {
+    unsigned num_threads = 0; // 0 to use every core
+    double max_seconds = 0.0; // Only analyze the start of the song. 0 for all of it.
+
+    // Stops the sweep early (returning no results) once set
+    const std::atomic<bool>* abort_requested = nullptr;
+    // Called with the fraction of the sweep done so far, from any of the worker threads
+    std::function<void(double)> on_progress;
+};
+
+/** Tries every configuration in `channels` against the audio of its channel, in
+ *  parallel, and returns the results for each channel sorted from best to worst.
+ *
+ *  Each channel of `synth` is only synthesized once, into memory, and shared by all of
+ *  the configurations tried on it. That takes about `sample rate * channels * 4` bytes
+ *  per second of audio per channel; use `max_seconds` to sweep over an excerpt of a
+ *  long song. `synth` must not have been read from yet.
+ */
+std::vector<std::vector<SweepResult>> sweep_triggers(
+    const std::shared_ptr<MidiSynth>& synth,
+    const std::vector<SweepChannel>& channels,
+    const SweepOptions& options = {});
+
+} // namespace osmium
+
+#endif // TRIGGERSWEEP_H
@@ -0,0 +1,87 @@
+#include "triggertrack.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace osmium {
+
+namespace {
+
+constexpr std::array<char, 4> TRACK_MAGIC{'O', 'S', 'T', 'T'};
+constexpr uint32_t TRACK_VERSION = 1;
+
+} // namespace
+
+std::optional<TriggerTrack> TriggerTrack::load(const fs::path& path, uint64_t key) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is)
+        return std::nullopt;
+
+    TriggerTrackHeader header;
+    is.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!is || std::memcmp(header.magic, TRACK_MAGIC.data(), TRACK_MAGIC.size()) != 0
+        || header.version != TRACK_VERSION || header.key != key)
+        return std::nullopt;
+
+    // Don't trust the frame count enough to allocate it before checking the file size
+    std::error_code ec;
+    uint64_t file_size = fs::file_size(path, ec);
+    if (ec || (file_size - sizeof(header)) / sizeof(int32_t) < header.num_frames)
+        return std::nullopt;
+
+    TriggerTrack track;
+    track.m_nudges.resize(header.num_frames);
+    is.read(reinterpret_cast<char*>(track.m_nudges.data()),
+            static_cast<std::streamsize>(header.num_frames * sizeof(int32_t)));
+    if (!is)
+        return std::nullopt;
+    return track;
+}
+
+bool TriggerTrack::save(const fs::path& path,
+                        uint64_t key,
+                        std::span<const int32_t> nudges) {
+    TriggerTrackHeader header{
+        .version = TRACK_VERSION, .key = key, .num_frames = nudges.size()};
+    std::memcpy(header.magic, TRACK_MAGIC.data(), TRACK_MAGIC.size());
+
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+
+    fs::path part_path = path;
+    part_path += ".part";
+    {
+        std::ofstream os(part_path, std::ios::binary | std::ios::trunc);
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(reinterpret_cast<const char*>(nudges.data()),
+                 static_cast<std::streamsize>(nudges.size_bytes()));
+        os.close();
+        if (os.fail()) {
+            fs::remove(part_path, ec);
+            return false;
+        }
+    }
+
+    // Renaming may fail if another render is reading the old track; that's harmless
+    fs::rename(part_path, path, ec);
+    if (ec) {
+        fs::remove(part_path, ec);
+        return false;
+    }
+    return true;
+}
+
+fs::path TriggerTrack::path_in(const fs::path& cache_dir, uint64_t key) {
+    return cache_dir / "triggers" / std::format("{:016x}.trig", key);
+}
+
+} // namespace osmium
@@ -0,0 +1,55 @@
+#ifndef TRIGGERTRACK_H
+#define TRIGGERTRACK_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace osmium {
+
+struct TriggerTrackHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t num_frames;
+};
+
+/** The nudge a scope picked for every frame of a render, saved so that later renders of
+ *  the same audio with the same trigger settings don't have to search for them again.
+ *
+ *  A track file is a `TriggerTrackHeader` followed by one `int32_t` per frame, where
+ *  `NO_NUDGE` marks frames in which no trigger point was found.
+ */
+class TriggerTrack {
+public:
+    static constexpr int32_t NO_NUDGE = -1;
+
+    /** Loads the track at `path`, or returns nothing if there isn't a valid track there
+     *  for `key`.
+     */
+    static std::optional<TriggerTrack> load(const std::filesystem::path& path,
+                                            uint64_t key);
+
+    /** Writes a track. Data goes to a temporary file which then replaces the real one,
+     *  so an interrupted write never leaves a truncated track. Returns false on failure.
+     */
+    static bool save(const std::filesystem::path& path,
+                     uint64_t key,
+                     std::span<const int32_t> nudges);
+
+    /** Where the track with the given key lives within a cache directory. */
+    static std::filesystem::path path_in(const std::filesystem::path& cache_dir,
+                                         uint64_t key);
+
+    uint64_t get_num_frames() const { return m_nudges.size(); }
+    int32_t get_nudge(uint64_t frame) const { return m_nudges[frame]; }
+
+private:
+    std::vector<int32_t> m_nudges;
+};
+
+} // namespace osmium
+
+#endif // TRIGGERTRACK_H